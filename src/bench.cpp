@@ -0,0 +1,344 @@
+// --- supercalc_bench: micro y macrobenchmarks con salida JSON ---
+// Uso: supercalc_bench [--filter TEXTO] [--threads N] [--grain N] [--pin]
+// Cada medida se repite RUNS veces y se informa la mediana; el número de
+// iteraciones se calibra para que cada repetición dure al menos MIN_RUN_MS.
+// Las entradas se generan con semillas fijas, así que dos ejecuciones sobre la
+// misma máquina y compilación miden exactamente el mismo trabajo.
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include "engine.hpp"
+
+using namespace std;
+using namespace supercalc::detail;
+
+static const int RUNS = 5;
+static const double MIN_RUN_MS = 20;
+
+struct BenchResult { string name, unit; double value; };
+static vector<BenchResult> g_results;
+static string g_filter;
+
+static bool wanted(const string& name){ return g_filter.empty() || name.find(g_filter)!=string::npos; }
+static void record(const string& name, const string& unit, double value){ g_results.push_back({name, unit, value}); }
+
+// Mediana de RUNS repeticiones de fn(), en ns por elemento; fn() procesa 'items' elementos.
+template<class F> static double nsPerItem(F fn, double items){
+    using clk = chrono::steady_clock;
+    fn(); // calentamiento
+    size_t calls = 1;
+    for(;;){
+        auto t0 = clk::now();
+        for(size_t i=0;i<calls;++i) fn();
+        double ms = chrono::duration<double, milli>(clk::now()-t0).count();
+        if(ms >= MIN_RUN_MS || calls >= (size_t(1)<<30)) break;
+        calls *= ms > 0 ? max<size_t>(2, (size_t)(MIN_RUN_MS/ms*1.2)) : 16;
+    }
+    vector<double> runs;
+    for(int r=0;r<RUNS;++r){
+        auto t0 = clk::now();
+        for(size_t i=0;i<calls;++i) fn();
+        runs.push_back(chrono::duration<double, nano>(clk::now()-t0).count()/calls/items);
+    }
+    sort(runs.begin(), runs.end());
+    return runs[RUNS/2];
+}
+
+// Evita que el compilador descarte resultados no usados.
+static volatile double g_sink;
+
+// Generador congruencial con semilla fija (reproducible entre plataformas).
+struct Lcg {
+    uint64_t s;
+    explicit Lcg(uint64_t seed): s(seed) {}
+    uint64_t next(){ s = s*6364136223846793005ULL + 1442695040888963407ULL; return s>>11; }
+    double uniform(double a, double b){ return a + (b-a)*(double)next()/(double)(1ULL<<53); }
+};
+
+// --- Corpus: líneas representativas de uso real ---
+static const char* const CORPUS_TEMPLATES[] = {
+    "3*x^2 + 1", "sin(pi/2) + cos(0.25)*2.5e-3", "pow(2, 8) - sqrt(16)/4", "x = 12.75",
+    "log10(1000) + ln(e) - abs(-3.5)", "(1.5 + y) * (2 - x) / 7.125", "floor(3.7) + ceil(1.2) + round(-2.5)",
+    "radius_2 = 0.5e-1 * 42", "exp(-x^2/2) / sqrt(2*pi)", "1e10 + .5 - 3.0E+2 * atan(1)"
+};
+
+// 'lines' líneas: las plantillas y variantes con literales distintos (para que
+// no todo sean aciertos de caché), y algunas asignaciones intercaladas.
+static vector<string> makeCorpus(size_t lines){
+    Lcg g(42); vector<string> out = {"x = 1.5", "y = -0.25"};
+    const size_t nt = sizeof CORPUS_TEMPLATES / sizeof CORPUS_TEMPLATES[0];
+    while(out.size() < lines){
+        uint64_t r = g.next() % 100;
+        if(r < 60) out.push_back(CORPUS_TEMPLATES[g.next() % nt]);
+        else if(r < 90){
+            ostringstream os; os << setprecision(6) << g.uniform(-100, 100) << "*x^2 + " << g.uniform(0, 10) << "*sin(y)";
+            out.push_back(os.str());
+        }
+        else { ostringstream os; os << "x = " << setprecision(4) << g.uniform(-5, 5); out.push_back(os.str()); }
+    }
+    return out;
+}
+
+// --- Lexer::next ---
+static void benchLexer(){
+    if(!wanted("lexer")) return;
+    size_t tokens = 0;
+    for(auto* l: CORPUS_TEMPLATES){ Lexer L(l); while(L.next().t!=TokType::End) ++tokens; }
+    auto pass = [&]{
+        for(auto* l: CORPUS_TEMPLATES){ Lexer L(l); for(Token t = L.next(); t.t!=TokType::End; t = L.next()) g_sink = t.value; }
+    };
+    uint64_t a0 = g_allocs.load();
+    pass();
+    uint64_t allocs = g_allocs.load()-a0;
+    record("lexer.next", "ns/token", nsPerItem(pass, (double)tokens));
+    record("lexer.allocs", "reservas/pasada", (double)allocs);
+}
+
+// --- toRPN: anidamiento profundo y expresiones anchas; el coste por carácter debe ser constante ---
+static void benchParser(){
+    struct Shape { const char* name; string open, close; };
+    const Shape deep[] = { {"calls", "sin(", ")"}, {"parens", "(", ")"}, {"sum", "1+(", ")"} };
+    for(const Shape& sh: deep)
+        for(size_t depth: {10, 100, 1000, 10000, 100000}){
+            string name = "parser.deep." + string(sh.name) + "." + to_string(depth);
+            if(!wanted(name)) continue;
+            string line;
+            for(size_t i=0;i<depth;++i) line += sh.open;
+            line += "x";
+            for(size_t i=0;i<depth;++i) line += sh.close;
+            record(name, "ns/char", nsPerItem([&]{ g_sink = (double)toRPN(line).size(); }, (double)line.size()));
+        }
+    for(size_t width: {10, 100, 1000, 10000, 100000}){
+        string name = "parser.wide." + to_string(width);
+        if(!wanted(name)) continue;
+        string line = "x";
+        for(size_t i=1;i<width;++i) line += (i%3==0 ? " + " : i%3==1 ? " * " : " - ") + string(i%2 ? "y" : "pow(x, 2)");
+        record(name, "ns/char", nsPerItem([&]{ g_sink = (double)toRPN(line).size(); }, (double)line.size()));
+    }
+}
+
+// --- runProgram: coste por instrucción del intérprete ---
+static void benchEval(){
+    for(size_t terms: {4, 32, 256}){
+        string name = "eval.node." + to_string(terms);
+        if(!wanted(name)) continue;
+        Env env; env.set("x", 1.25); env.set("y", -0.5);
+        string line = "x";
+        for(size_t i=1;i<terms;++i) line += i%2 ? "*y+x" : "-x*y";
+        Program p = compileRPN(toRPN(line), env);
+        record(name, "ns/instr", nsPerItem([&]{ g_sink = runProgram(p, env.vals.data()); }, (double)p.code.size()));
+    }
+}
+
+// --- Funciones integradas: escalar (puntero de UF/BF) y por columnas (núcleo SIMD) ---
+static void benchFunctions(){
+    const size_t N = 4096;
+    vector<double> a(N), b(N), o(N);
+    for(auto& kv: UF){
+        const string& fn = kv.first;
+        if(!wanted("func."+fn)) continue;
+        Lcg g(7);
+        double lo = -10, hi = 10;
+        if(fn=="asin" || fn=="acos"){ lo = -1; hi = 1; }
+        if(fn=="ln" || fn=="log" || fn=="log10" || fn=="sqrt"){ lo = 1e-3; hi = 1e3; }
+        for(auto& v: a) v = g.uniform(lo, hi);
+        UFunc f = kv.second.f; F1 id = kv.second.id;
+        record("func."+fn+".scalar", "ns/llamada", nsPerItem([&]{ for(size_t i=0;i<N;++i) o[i] = f(a[i]); g_sink = o[N-1]; }, (double)N));
+        record("func."+fn+".column", "ns/elem", nsPerItem([&]{ mapF1(id, a.data(), o.data(), N); g_sink = o[N-1]; }, (double)N));
+    }
+    for(auto& kv: BF){
+        const string& fn = kv.first;
+        if(!wanted("func."+fn)) continue;
+        Lcg g(11);
+        for(size_t i=0;i<N;++i){ a[i] = g.uniform(0.1, 10); b[i] = g.uniform(-3, 3); }
+        BFunc f = kv.second.f;
+        record("func."+fn+".scalar", "ns/llamada", nsPerItem([&]{ for(size_t i=0;i<N;++i) o[i] = f(a[i], b[i]); g_sink = o[N-1]; }, (double)N));
+        record("func."+fn+".column", "ns/elem", nsPerItem([&]{ simdKernels().pow(a.data(), b.data(), o.data(), N); g_sink = o[N-1]; }, (double)N));
+    }
+}
+
+// --- Polinomio por columnas: pow, exponentes literales (sin fast-math, siguen siendo pow) y fast-math ---
+static void benchPoly(){
+    const size_t rows = size_t(1)<<20;
+    vector<double> x(rows), out(rows);
+    for(size_t i=0;i<rows;++i) x[i] = 0.5 + (double)i/rows;
+    struct Case { const char* name; const char* expr; bool fast; };
+    const Case cases[] = {
+        {"pow", "3*x^k3 - 2*x^k2 + x^k4/5 + 1", false},
+        {"exact", "3*x^3 - 2*x^2 + x^4/5 + 1", false},
+        {"fastmath", "3*x^3 - 2*x^2 + x^4/5 + 1", true},
+    };
+    for(const Case& c: cases){
+        string name = string("column.poly.") + c.name;
+        if(!wanted(name)) continue;
+        Env env; env.fastMath = c.fast;
+        env.set("k2", 2); env.set("k3", 3); env.set("k4", 4);
+        Program p = compileRPN(toRPN(c.expr), env, true);
+        vector<ColumnBinding> bind = {{"x", x.data()}};
+        record(name, "ns/fila", nsPerItem([&]{ evalColumns(p, env, bind, rows, out.data()); }, (double)rows));
+    }
+}
+
+// --- Escalado por columnas con 1..N hilos; cada grupo se crea una vez y se reutiliza ---
+static void benchScaling(unsigned maxThreads, size_t grain, bool pin){
+    const size_t rows = size_t(1)<<22;
+    vector<double> x(rows), out(rows);
+    for(size_t i=0;i<rows;++i) x[i] = -4.0 + 8.0*(double)i/rows;
+    struct Case { const char* name; const char* expr; };
+    const Case cases[] = { {"heavy", "sin(x)*exp(-x^2/2) + sqrt(abs(cos(3*x))) + atan(x)"}, {"light", "3*x + 1"} };
+    vector<unsigned> counts;
+    for(unsigned t=1; t<maxThreads; t*=2) counts.push_back(t);
+    counts.push_back(maxThreads);
+    for(const Case& c: cases){
+        if(!wanted(string("column.scaling.") + c.name)) continue;
+        Env env; Program p = compileRPN(toRPN(c.expr), env, true);
+        vector<ColumnBinding> bind = {{"x", x.data()}};
+        double base = 0;
+        for(unsigned t: counts){
+            WorkPool pool(t, pin);
+            double ns = nsPerItem([&]{ evalColumns(p, env, bind, rows, out.data(), &pool, grain); }, (double)rows);
+            if(t==1) base = ns;
+            string name = string("column.scaling.") + c.name + "." + to_string(t);
+            record(name, "ns/fila", ns);
+            record(name + ".speedup", "x", base/ns);
+        }
+    }
+}
+
+// --- Gradiente de una fórmula con N variables: diferencias finitas centradas
+// (2N+1 evaluaciones), modo directo (N tangentes en una pasada) y cinta inversa ---
+static void benchGradient(){
+    for(size_t n: {4, 32}){
+        string prefix = "grad." + to_string(n);
+        if(!wanted(prefix)) continue;
+        Env env; string expr; vector<uint32_t> seeds;
+        Lcg g(23);
+        for(size_t i=0;i<n;++i){
+            string v = "v" + to_string(i);
+            env.set(v, g.uniform(0.5, 2));
+            expr += (i ? " + " : "") + to_string(i+1) + "*sin(" + v + ")*" + v + "^2";
+            if(i) expr += "/(1 + v" + to_string(i-1) + ")";
+        }
+        Program p = compileRPN(toRPN(expr), env);
+        for(size_t i=0;i<n;++i) seeds.push_back(env.slotOf.at("v" + to_string(i)));
+        vector<double> d(n), vars = env.vals;
+        record(prefix + ".finite_diff", "ns/gradiente", nsPerItem([&]{
+            const double h = 1e-6;
+            double f0 = runProgram(p, vars.data());
+            for(size_t j=0;j<n;++j){
+                double x = vars[seeds[j]];
+                vars[seeds[j]] = x+h; double fp = runProgram(p, vars.data());
+                vars[seeds[j]] = x-h; double fm = runProgram(p, vars.data());
+                vars[seeds[j]] = x; d[j] = (fp-fm)/(2*h);
+            }
+            g_sink = f0 + d[n-1];
+        }, 1));
+        record(prefix + ".forward", "ns/gradiente", nsPerItem([&]{
+            g_sink = runProgramDual(p, vars.data(), seeds.data(), n, d.data()) + d[n-1];
+        }, 1));
+        GradTape t; t.bind(p);
+        vector<double> grad(vars.size());
+        record(prefix + ".reverse", "ns/gradiente", nsPerItem([&]{
+            fill(grad.begin(), grad.end(), 0.0);
+            g_sink = t.forward(p, vars.data()); t.backward(p, grad.data());
+        }, 1));
+    }
+}
+
+// --- Memoización: barrido de una rejilla 2D en el que la parte que solo depende
+// de x se repite en cada fila; con memo, g(x) se calcula una vez por columna ---
+static void benchMemo(){
+    if(!wanted("memo")) return;
+    const size_t NX = 64, NY = 64;
+    for(bool memo: {false, true}){
+        Env env; env.memo = memo; ExprCache cache; string out;
+        functionLine("g(t) = sin(t)*exp(-t/4) + cos(3*t)*ln(1 + t*t) + atan(t)/(1 + t^2) + cbrt(t)*sin(2*t)", env, cache, out);
+        env.set("x", 0); env.set("y", 0);
+        Program p = compileRPN(toRPN("g(x) + g(x)*y"), env);
+        uint32_t sx = env.slotOf.at("x"), sy = env.slotOf.at("y");
+        memoCache().clear();
+        record(string("memo.grid.") + (memo ? "on" : "off"), "ns/punto", nsPerItem([&]{
+            double acc = 0;
+            for(size_t j=0;j<NY;++j)
+                for(size_t i=0;i<NX;++i){
+                    env.vals[sx] = 0.1*(double)i; env.vals[sy] = 0.1*(double)j;
+                    acc += runProgram(p, env.vals.data());
+                }
+            g_sink = acc;
+        }, (double)(NX*NY)));
+    }
+}
+
+// --- Extremo a extremo: líneas por segundo a través de batchLine sobre el corpus ---
+static void benchEndToEnd(){
+    const vector<string> corpus = makeCorpus(100000);
+    struct Case { const char* name; size_t budget; };
+    const Case cases[] = { {"e2e.batch.cached", size_t(4)<<20}, {"e2e.batch.uncached", 0} };
+    for(const Case& c: cases){
+        if(!wanted(c.name)) continue;
+        string out; out.reserve(size_t(1)<<16);
+        double ns = nsPerItem([&]{
+            Env env; ExprCache cache; cache.setBudget(c.budget);
+            for(const string& l: corpus){
+                batchLine(l, env, cache, out);
+                if(out.size() > (size_t(1)<<16)) out.clear();
+            }
+            out.clear();
+        }, (double)corpus.size());
+        record(c.name, "lineas/s", 1e9/ns);
+    }
+}
+
+static string jsonEscape(const string& s){
+    string o;
+    for(char ch: s){
+        if(ch=='"' || ch=='\\') o += '\\';
+        o += ch;
+    }
+    return o;
+}
+
+int main(int argc, char** argv){
+    unsigned threads = max(1u, thread::hardware_concurrency());
+    size_t grain = 16; bool pin = false;
+    for(int i=1;i<argc;++i){
+        string a = argv[i];
+        if(a=="--filter" && i+1<argc) g_filter = argv[++i];
+        else if(a=="--threads" && i+1<argc) threads = (unsigned)max(1, atoi(argv[++i]));
+        else if(a=="--grain" && i+1<argc) grain = (size_t)max(1, atoi(argv[++i]));
+        else if(a=="--pin") pin = true;
+        else { cerr << "Uso: supercalc_bench [--filter TEXTO] [--threads N] [--grain N] [--pin]\n"; return 2; }
+    }
+
+    benchLexer();
+    benchParser();
+    benchEval();
+    benchFunctions();
+    benchPoly();
+    benchScaling(threads, grain, pin);
+    benchGradient();
+    benchMemo();
+    benchEndToEnd();
+
+    cout << "{\n  \"suite\": \"supercalc\",\n"
+         << "  \"isa\": \"" << simdKernels().isa << "\",\n"
+         << "  \"threads\": " << threads << ",\n"
+#if defined(__VERSION__)
+         << "  \"compiler\": \"" << jsonEscape(__VERSION__) << "\",\n"
+#endif
+         << "  \"runs\": " << RUNS << ",\n  \"results\": [";
+    for(size_t i=0;i<g_results.size();++i){
+        const BenchResult& r = g_results[i];
+        char num[NUM_BUF];
+        string v(num, formatNumber(num, r.value, NumFormat::Shortest, 0));
+        if(!isfinite(r.value)) v = "null";
+        cout << (i ? ",\n" : "\n") << "    {\"name\": \"" << jsonEscape(r.name) << "\", \"unit\": \"" << jsonEscape(r.unit) << "\", \"value\": " << v << "}";
+    }
+    cout << "\n  ]\n}\n";
+
+    // el lexer no debe reservar memoria: si lo hace es una regresión
+    for(auto& r: g_results) if(r.name=="lexer.allocs" && r.value!=0) return 1;
+    return 0;
+}
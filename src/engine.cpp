@@ -0,0 +1,1323 @@
+// --- Motor de SuperCalc: las partes que no van inline en engine.hpp ---
+#include "engine.hpp"
+#include <cstring>
+
+namespace supercalc::detail {
+
+using std::memcpy;
+
+// --- Análisis sintáctico ---
+struct OpInfo { int prec; bool rightAssoc; };
+
+static const unordered_map<string, OpInfo> OP = {
+    {"+", {1,false}}, {"-", {1,false}}, {"*", {2,false}}, {"/", {2,false}}, {"^", {3,true}},
+    {"u-", {4,true}} // menos unario
+};
+
+static bool isOpTok(TokType t){ return t==TokType::Plus||t==TokType::Minus||t==TokType::Star||t==TokType::Slash||t==TokType::Caret; }
+
+vector<Node> toRPN(string_view line){
+    struct Pending { enum Kind{Op, Paren, Call} k; const char* sym; int prec; string_view name; int argc; };
+    Lexer L(line); vector<Node> out; vector<Pending> ops;
+    auto reduce = [&](int minPrec){ // emite operadores pendientes con precedencia >= minPrec
+        while(!ops.empty() && ops.back().k==Pending::Op && ops.back().prec>=minPrec){
+            out.push_back({Node::KOp, 0, ops.back().sym}); ops.pop_back();
+        }
+    };
+
+    Token tok = L.next();
+    // asignación: nombre = expresión (solo al principio de la línea)
+    {
+        Lexer peek = L; Token t2 = peek.next();
+        if(tok.t==TokType::Ident && t2.t==TokType::Assign){
+            out.push_back({Node::KVar, 0, string(tok.text)});
+            L = peek; tok = L.next();
+        }
+    }
+    const bool assign = !out.empty();
+
+    bool expectOperand = true;
+    for(;; tok = L.next()){
+        if(expectOperand){
+            switch(tok.t){
+                case TokType::Number: out.push_back({Node::KNum, tok.value, {}}); expectOperand = false; continue;
+                case TokType::Ident: {
+                    Lexer peek = L;
+                    if(peek.next().t==TokType::LParen){ L = peek; ops.push_back({Pending::Call, nullptr, 0, tok.text, 0}); }
+                    else { out.push_back({Node::KVar, 0, string(tok.text)}); expectOperand = false; }
+                    continue;
+                }
+                case TokType::LParen: ops.push_back({Pending::Paren, nullptr, 0, {}, 0}); continue;
+                case TokType::Minus: ops.push_back({Pending::Op, "u-", 4, {}, 0}); continue;
+                case TokType::RParen: // llamada sin argumentos: f()
+                    if(!ops.empty() && ops.back().k==Pending::Call && ops.back().argc==0){
+                        out.push_back({Node::KFunc, 0, string(ops.back().name), 0}); ops.pop_back();
+                        expectOperand = false; continue;
+                    }
+                    break;
+                default: break;
+            }
+            if(tok.t==TokType::End || tok.t==TokType::RParen || tok.t==TokType::Comma || isOpTok(tok.t))
+                throw CalcError(ErrCode::Syntax, "Falta un operando");
+            throw CalcError(ErrCode::Syntax, "Token inesperado");
+        }
+
+        if(isOpTok(tok.t)){
+            const char* sym = tok.t==TokType::Plus?"+": tok.t==TokType::Minus?"-": tok.t==TokType::Star?"*": tok.t==TokType::Slash?"/":"^";
+            const OpInfo& oi = OP.at(sym);
+            reduce(oi.rightAssoc ? oi.prec+1 : oi.prec);
+            ops.push_back({Pending::Op, sym, oi.prec, {}, 0});
+            expectOperand = true;
+        }
+        else if(tok.t==TokType::Comma){
+            reduce(0);
+            if(ops.empty() || ops.back().k!=Pending::Call) throw CalcError(ErrCode::Syntax, "Coma fuera de contexto");
+            ++ops.back().argc; expectOperand = true;
+        }
+        else if(tok.t==TokType::RParen){
+            reduce(0);
+            if(ops.empty()) throw CalcError(ErrCode::Syntax, "Paréntesis desbalanceados");
+            if(ops.back().k==Pending::Call) out.push_back({Node::KFunc, 0, string(ops.back().name), ops.back().argc+1});
+            ops.pop_back();
+        }
+        else if(tok.t==TokType::End){
+            reduce(0);
+            if(!ops.empty()) throw CalcError(ErrCode::Syntax, "Paréntesis desbalanceados");
+            break;
+        }
+        else if(tok.t==TokType::Assign) throw CalcError(ErrCode::Syntax, "Asignación inválida. Usa: nombre = expresión");
+        else throw CalcError(ErrCode::Syntax, "Token inesperado");
+    }
+    if(assign) out.push_back({Node::KAssign, 0, {}});
+    return out;
+}
+
+// --- Funciones integradas ---
+const unordered_map<string,UFEntry> UF = {
+    {"sin", {F1::Sin, [](double a){return sin(a);}}}, {"cos", {F1::Cos, [](double a){return cos(a);}}}, {"tan", {F1::Tan, [](double a){return tan(a);}}},
+    {"asin", {F1::Asin, [](double a){return asin(a);}}}, {"acos", {F1::Acos, [](double a){return acos(a);}}}, {"atan", {F1::Atan, [](double a){return atan(a);}}},
+    {"sqrt", {F1::Sqrt, [](double a){return sqrt(a);}}}, {"cbrt", {F1::Cbrt, [](double a){return cbrt(a);}}}, {"exp", {F1::Exp, [](double a){return exp(a);}}},
+    {"abs", {F1::Abs, [](double a){return fabs(a);}}}, {"floor", {F1::Floor, [](double a){return floor(a);}}}, {"ceil", {F1::Ceil, [](double a){return ceil(a);}}}, {"round", {F1::Round, [](double a){return round(a);}}},
+    {"ln", {F1::Ln, [](double a){return log(a);}}}, {"log", {F1::Ln, [](double a){return log(a);}}}, {"log10", {F1::Log10, [](double a){return log10(a);}}}
+};
+
+const unordered_map<string,BFEntry> BF = {
+    {"pow", {F2::Pow, [](double a,double b){ return pow(a,b); }}}
+};
+
+// --- Compilación a bytecode ---
+static Op opFromText(const string& t){
+    if(t=="u-") return Op::Neg;
+    if(t=="+") return Op::Add;
+    if(t=="-") return Op::Sub;
+    if(t=="*") return Op::Mul;
+    if(t=="/") return Op::Div;
+    if(t=="^") return Op::Pow;
+    throw CalcError(ErrCode::Syntax, "Operador desconocido: "+t);
+}
+
+void foldProgram(Program& p, const Env& env){
+    struct Ent { size_t start; bool isConst; double v; }; // subexpresión en la pila
+    vector<Instr> out; out.reserve(p.code.size());
+    vector<Ent> st;
+    auto is = [](const Ent& e, double k){ return e.isConst && e.v==k && signbit(e.v)==signbit(k); };
+    auto num = [&](size_t start, double v){
+        out.resize(start, Instr(Op::Num));
+        Instr in(Op::Num); in.num = v; out.push_back(in);
+        st.push_back({start, true, v});
+    };
+    for(const Instr& in: p.code){
+        switch(in.op){
+            case Op::Num: num(out.size(), in.num); break;
+            case Op::Var:
+                if(env.defined[in.arg] && env.consts.count(env.names[in.arg])){ num(out.size(), env.vals[in.arg]); break; }
+                st.push_back({out.size(), false, 0}); out.push_back(in);
+                break;
+            case Op::Neg: case Op::Call1: case Op::Sqr: case Op::PowI: {
+                Ent a = st.back(); st.pop_back();
+                if(a.isConst){
+                    num(a.start, in.op==Op::Neg ? -a.v : in.op==Op::Call1 ? in.f1(a.v) : in.op==Op::Sqr ? a.v*a.v : powi(a.v, (int32_t)in.arg));
+                    break;
+                }
+                if(in.op==Op::Neg && out.back().op==Op::Neg) out.pop_back();
+                else out.push_back(in);
+                st.push_back(a);
+                break;
+            }
+            case Op::Arg: st.push_back({out.size(), false, 0}); out.push_back(in); break;
+            case Op::CallU: {
+                size_t n = in.uf->nargs, start = n ? st[st.size()-n].start : out.size();
+                if(in.uf->pure && all_of(st.end()-n, st.end(), [](const Ent& e){ return e.isConst; })){
+                    double args[256]; // CallU no admite más argumentos
+                    for(size_t i=0;i<n;++i) args[i] = st[st.size()-n+i].v;
+                    try{ double v = runProgram(in.uf->body, nullptr, args); st.resize(st.size()-n); num(start, v); break; }
+                    catch(const CalcError&){} // p. ej. división por cero: el error aparece al evaluar
+                }
+                st.resize(st.size()-n); st.push_back({start, false, 0}); out.push_back(in);
+                break;
+            }
+            case Op::Ret: out.push_back(in); break;
+            default: { // Add, Sub, Mul, Div, Pow, Call2
+                Ent b = st.back(); st.pop_back();
+                Ent a = st.back(); st.pop_back();
+                bool pw = in.op==Op::Pow || (in.op==Op::Call2 && in.fn==(uint8_t)F2::Pow);
+                if(a.isConst && b.isConst && !(in.op==Op::Div && b.v==0.0)){
+                    double v = in.op==Op::Add ? a.v+b.v : in.op==Op::Sub ? a.v-b.v : in.op==Op::Mul ? a.v*b.v
+                             : in.op==Op::Div ? a.v/b.v : in.op==Op::Pow ? pow(a.v,b.v) : in.f2(a.v,b.v);
+                    num(a.start, v); break;
+                }
+                if(((in.op==Op::Mul || in.op==Op::Div || pw) && is(b,1.0)) || (in.op==Op::Sub && is(b,0.0)) || (in.op==Op::Add && is(b,-0.0)))
+                    out.resize(b.start, Instr(Op::Num));
+                else if((in.op==Op::Mul && is(a,1.0)) || (in.op==Op::Add && is(a,-0.0)))
+                    out.erase(out.begin()+a.start, out.begin()+b.start);
+                else if(pw && b.isConst && b.v==0.0 && none_of(out.begin()+a.start, out.begin()+b.start, [](const Instr& i){ return i.op==Op::Div || i.op==Op::CallU; })){
+                    num(a.start, 1.0); break;
+                }
+                else if(pw && b.isConst && env.fastMath && b.v==nearbyint(b.v) && fabs(b.v)<=POWI_MAX){
+                    out.resize(b.start, Instr(Op::Num));
+                    Instr r(b.v==2.0 ? Op::Sqr : Op::PowI); r.arg = (uint32_t)(int32_t)b.v;
+                    out.push_back(r);
+                }
+                else if(pw && b.isConst && env.fastMath && b.v==0.5){
+                    out.resize(b.start, Instr(Op::Num));
+                    Instr r(Op::Call1); r.fn = (uint8_t)F1::Sqrt; r.f1 = UF.at("sqrt").f;
+                    out.push_back(r);
+                }
+                else out.push_back(in);
+                st.push_back({a.start, false, 0});
+            }
+        }
+    }
+    size_t depth = 0; p.maxDepth = 0;
+    for(auto& in: out){
+        if(in.op==Op::Num || in.op==Op::Var || in.op==Op::Arg){ if(++depth > p.maxDepth) p.maxDepth = depth; }
+        else if(in.op==Op::CallU){ depth -= in.uf->nargs; if(++depth > p.maxDepth) p.maxDepth = depth; }
+        else if(in.op!=Op::Neg && in.op!=Op::Call1 && in.op!=Op::Sqr && in.op!=Op::PowI && in.op!=Op::Ret) --depth;
+    }
+    p.code = move(out);
+}
+
+// Identificadores de función en MemoCache: F1, F2 y las de usuario por UserFunc::id.
+static const uint32_t MEMO_F1 = 1, MEMO_F2 = 64, MEMO_USER = 256;
+
+// Saca de 'code' el código de las n últimas entradas de la pila ('starts':
+// dónde empieza cada una), una por argumento.
+static vector<vector<Instr>> takeArgs(vector<Instr>& code, const vector<size_t>& starts, size_t n){
+    vector<vector<Instr>> args(n);
+    for(size_t i=0;i<n;++i){
+        size_t b = starts[starts.size()-n+i], e = i+1<n ? starts[starts.size()-n+i+1] : code.size();
+        args[i].assign(code.begin()+b, code.begin()+e);
+    }
+    if(n) code.resize(starts[starts.size()-n], Instr(Op::Num));
+    return args;
+}
+
+// Añade a 'out' el código de un cuerpo sin su Ret, con cada Arg i sustituido
+// por args[i] (sin args, para expandir el propio cuerpo, se copian). Con deep
+// expande también sus CallU; si no, las copia. false si 'out' pasa de 'limit'
+// instrucciones.
+static bool expandCode(const vector<Instr>& code, const vector<vector<Instr>>& args, bool deep, vector<Instr>& out, size_t limit){
+    vector<size_t> starts; // inicio en 'out' de cada entrada de la pila
+    for(const Instr& in: code){
+        if(out.size() > limit) return false;
+        switch(in.op){
+            case Op::Ret: return true;
+            case Op::Num: case Op::Var: starts.push_back(out.size()); out.push_back(in); break;
+            case Op::Arg:
+                starts.push_back(out.size());
+                if(args.empty()) out.push_back(in); else out.insert(out.end(), args[in.arg].begin(), args[in.arg].end());
+                break;
+            case Op::Neg: case Op::Sqr: case Op::PowI: case Op::Call1: out.push_back(in); break;
+            case Op::Memo:
+                if(in.fn!=2){ // vuelve a ser Call1/Call2
+                    Instr c(in.fn==0 ? Op::Call1 : Op::Call2);
+                    if(in.fn==0){ c.fn = (uint8_t)(in.arg - MEMO_F1); c.f1 = in.f1; }
+                    else { c.fn = (uint8_t)(in.arg - MEMO_F2); c.f2 = in.f2; starts.pop_back(); }
+                    out.push_back(c); break;
+                }
+                [[fallthrough]];
+            case Op::CallU: {
+                size_t n = in.uf->nargs, start = n ? starts[starts.size()-n] : out.size();
+                if(deep){
+                    vector<vector<Instr>> a = takeArgs(out, starts, n);
+                    if(!expandCode(in.uf->body.code, a, true, out, limit)) return false;
+                } else out.push_back(in);
+                starts.resize(starts.size()-n); starts.push_back(start);
+                break;
+            }
+            default: starts.pop_back(); out.push_back(in); // binarios
+        }
+    }
+    return true;
+}
+
+// sum, prod, min y max con cuatro argumentos: reducciones (ver reduceLine); con
+// otra aridad, los nombres quedan libres para funciones de usuario.
+static bool isReduction(const string& n, size_t argc){ return argc==4 && (n=="sum" || n=="prod" || n=="min" || n=="max"); }
+
+Program compileRPN(const vector<Node>& rpn, Env& env, bool allowFree, const vector<string>* params){
+    Program p; size_t first = 0, last = rpn.size();
+    size_t assigns = 0;
+    for(auto& n: rpn){
+        if(n.k==Node::KAssign) ++assigns;
+        // antes de compilar los argumentos: el índice no es una variable definida
+        else if(n.k==Node::KFunc && isReduction(n.text, (size_t)n.argc))
+            throw CalcError(ErrCode::Unsupported, n.text+"(...) solo como línea completa: "+n.text+"(expresión, variable, inicio, fin)");
+    }
+    if(assigns){
+        // toRPN emite la asignación como: nombre <rhs...> =
+        if(assigns!=1 || rpn.size()<3 || rpn[0].k!=Node::KVar || rpn.back().k!=Node::KAssign || UF.count(rpn[0].text) || BF.count(rpn[0].text))
+            throw CalcError(ErrCode::Syntax, "Asignación inválida. Usa: nombre = expresión");
+        p.target = rpn[0].text; p.targetSlot = env.intern(p.target); first = 1; last = rpn.size()-1;
+    }
+
+    vector<size_t> starts; // inicio en p.code de cada entrada de la pila
+    auto push = [&](Instr in){ starts.push_back(p.code.size()); p.code.push_back(in); };
+    for(size_t i=first;i<last;++i){
+        const Node& n = rpn[i];
+        if(n.k==Node::KNum){ Instr in(Op::Num); in.num = n.val; push(in); }
+        else if(n.k==Node::KFunc){
+            auto itF1 = UF.find(n.text);
+            auto itF2 = BF.find(n.text);
+            auto itU = itF1==UF.end() && itF2==BF.end() ? env.funcs.find(n.text) : env.funcs.end();
+            if(itF1==UF.end() && itF2==BF.end() && itU==env.funcs.end()) throw CalcError(ErrCode::UnknownFunction, "Función desconocida: "+n.text);
+            int arity = itF1!=UF.end() ? 1 : itF2!=BF.end() ? 2 : (int)itU->second->params.size();
+            if(n.argc!=arity)
+                throw CalcError(ErrCode::Arity, "La función "+n.text+" espera "+to_string(arity)+(arity==1?" argumento":" argumentos"));
+            if(itF1!=UF.end()){
+                Instr in(Op::Call1); in.fn = (uint8_t)itF1->second.id; in.f1 = itF1->second.f;
+                p.code.push_back(in);
+            } else if(itF2!=BF.end()){
+                Instr in(Op::Call2); in.fn = (uint8_t)itF2->second.id; in.f2 = itF2->second.f;
+                p.code.push_back(in); starts.pop_back();
+            } else {
+                const UserFunc& f = *itU->second;
+                vector<vector<Instr>> all = takeArgs(p.code, starts, (size_t)arity), args;
+                starts.resize(starts.size()-arity);
+                for(size_t a=0;a<all.size();++a) if(f.argOf[a]>=0) args.push_back(move(all[a]));
+                // se expande si es pequeño y no repite el cálculo de ningún argumento
+                bool inl = f.body.code.size()-1 <= INLINE_MAX;
+                for(size_t a=0;a<args.size();++a) if(f.uses[a]>1 && args[a].size()>1) inl = false;
+                starts.push_back(p.code.size());
+                if(inl){
+                    expandCode(f.body.code, args, false, p.code, SIZE_MAX);
+                    p.funcs.insert(p.funcs.end(), f.body.funcs.begin(), f.body.funcs.end());
+                } else {
+                    for(auto& a: args) p.code.insert(p.code.end(), a.begin(), a.end());
+                    Instr in(Op::CallU); in.uf = &f; p.code.push_back(in);
+                    p.funcs.push_back(itU->second);
+                }
+            }
+        }
+        else if(n.k==Node::KVar){
+            if(params){
+                auto it = find(params->begin(), params->end(), n.text);
+                if(it!=params->end()){ Instr in(Op::Arg); in.arg = (uint32_t)(it-params->begin()); push(in); continue; }
+            }
+            if(!allowFree && !env.isDefined(n.text)) throw CalcError(ErrCode::UnknownVariable, "Variable no definida: "+n.text);
+            Instr in(Op::Var); in.arg = env.intern(n.text);
+            push(in);
+        }
+        else if(n.k==Node::KOp){
+            Op op = opFromText(n.text);
+            size_t need = (op==Op::Neg?1:2);
+            if(starts.size()<need) throw CalcError(ErrCode::Syntax, string("Pila insuficiente (operador ")+n.text+")");
+            p.code.push_back(Instr(op)); if(need==2) starts.pop_back();
+        }
+    }
+    if(starts.size()!=1) throw CalcError(ErrCode::Syntax, p.target.empty() ? "Expresión inválida" : "Expresión inválida en asignación");
+    p.code.push_back(Instr(Op::Ret));
+    foldProgram(p, env);
+    if(env.memo && !params) memoizeCalls(p);
+    p.calls = any_of(p.code.begin(), p.code.end(), [](const Instr& in){ return in.op==Op::CallU || in.op==Op::Memo; });
+    // sin expandir: los cuerpos llamados traen las suyas de su propia compilación
+    auto read = [&](uint32_t s){ if(find(p.reads.begin(), p.reads.end(), s)==p.reads.end()) p.reads.push_back(s); };
+    for(const Instr& in: p.code){
+        if(in.op==Op::Var) read(in.arg);
+        else if(in.op==Op::CallU || (in.op==Op::Memo && in.fn==2)) for(uint32_t s: in.uf->body.reads) read(s);
+    }
+    if(p.calls){
+        auto f = make_shared<Program>();
+        if(expandCode(p.code, {}, true, f->code, FLAT_MAX)){
+            f->code.push_back(Instr(Op::Ret));
+            foldProgram(*f, env);
+            p.flat = move(f);
+        }
+    }
+    return p;
+}
+
+// Compila sin plegar pi ni e: lo que se guarda para más tarde (cuerpos de
+// funciones, definiciones :=) debe ver su valor si se reasignan.
+static Program compileUnfolded(const vector<Node>& rpn, Env& env, const vector<string>* params = nullptr){
+    unordered_set<string> consts; swap(consts, env.consts);
+    Program p;
+    try{ p = compileRPN(rpn, env, false, params); }
+    catch(...){ swap(consts, env.consts); throw; }
+    swap(consts, env.consts);
+    return p;
+}
+
+// --- Funciones de usuario ---
+size_t parseFuncHead(string_view line, string_view& name, vector<string_view>& params){
+    Lexer L(line);
+    Token t = L.next();
+    if(t.t!=TokType::Ident || L.next().t!=TokType::LParen) return 0;
+    name = t.text; params.clear();
+    t = L.next();
+    if(t.t!=TokType::RParen)
+        for(;;){
+            if(t.t!=TokType::Ident) return 0;
+            params.push_back(t.text);
+            t = L.next();
+            if(t.t==TokType::RParen) break;
+            if(t.t!=TokType::Comma) return 0;
+            t = L.next();
+        }
+    return L.next().t==TokType::Assign ? L.i : 0;
+}
+
+void defineFunction(Env& env, string_view name, const vector<string_view>& params, string_view body){
+    string n(name);
+    if(UF.count(n) || BF.count(n) || n=="diff" || n=="grad" || n=="sweep" || n=="load")
+        throw CalcError(ErrCode::Syntax, "No se puede redefinir la función integrada "+n);
+    if(isReduction(n, params.size()))
+        throw CalcError(ErrCode::Syntax, n+" con cuatro parámetros es la reducción integrada; usa otro nombre u otra aridad");
+    if(params.size() > 255) throw CalcError(ErrCode::Unsupported, "Demasiados parámetros");
+    static atomic<uint32_t> nextId{0};
+    auto f = make_shared<UserFunc>();
+    f->name = n; f->src = string(trimView(body)); f->id = ++nextId;
+    for(auto& s: params){
+        if(find(f->params.begin(), f->params.end(), s)!=f->params.end())
+            throw CalcError(ErrCode::Syntax, "Parámetro repetido: "+string(s));
+        f->params.emplace_back(s);
+    }
+    vector<Node> rpn = toRPN(f->src);
+    // solo los parámetros que aparecen en el cuerpo reciben Arg
+    vector<string> used;
+    for(auto& s: f->params){
+        bool u = any_of(rpn.begin(), rpn.end(), [&](const Node& nd){ return nd.k==Node::KVar && nd.text==s; });
+        f->argOf.push_back(u ? (int)used.size() : -1);
+        if(u) used.push_back(s);
+    }
+    f->body = compileUnfolded(rpn, env, &used);
+    if(!f->body.target.empty()) throw CalcError(ErrCode::Syntax, "El cuerpo de una función no puede ser una asignación");
+    f->nargs = (uint32_t)used.size();
+    f->uses.assign(used.size(), 0);
+    for(auto& in: f->body.code) if(in.op==Op::Arg) ++f->uses[in.arg];
+    f->pure = f->body.reads.empty();
+    env.funcs[n] = move(f);
+}
+
+bool functionLine(string_view line, Env& env, ExprCache& cache, string& out, bool batch){
+    string_view name; vector<string_view> params;
+    size_t at = parseFuncHead(line, name, params);
+    if(!at) return false;
+    defineFunction(env, name, params, line.substr(at));
+    cache.clear();
+    if(batch) return true;
+    const UserFunc& f = *env.funcs[string(name)];
+    out.append("[ok] ").append(name).push_back('(');
+    for(size_t i=0;i<f.params.size();++i) out.append(i ? ", " : "").append(f.params[i]);
+    out.append(") = ").append(f.src);
+    return true;
+}
+
+// --- Memoización ---
+static size_t memoHash(uint32_t fn, const uint64_t* args, size_t n){
+    uint64_t h = fn * 0x9E3779B97F4A7C15ULL;
+    for(size_t i=0;i<n;++i){ h ^= args[i]; h = (h << 31 | h >> 33) * 0x9E3779B97F4A7C15ULL; }
+    // mezcla final de MurmurHash3: los doubles "redondos" solo difieren en los bits altos
+    h ^= h >> 33; h *= 0xFF51AFD7ED558CCDULL; h ^= h >> 33; h *= 0xC4CEB9FE1A85EC53ULL; h ^= h >> 33;
+    return (size_t)h;
+}
+
+const double* MemoCache::find(uint32_t fn, const uint64_t* a, size_t n, size_t h){
+    size_t mask = table.size()-1;
+    for(size_t w=0;w<WAYS;++w){
+        Entry& e = table[(h+w) & mask];
+        if(e.fn==fn && e.n==n && equal(a, a+n, e.args)){ e.used = 1; return &e.result; }
+    }
+    return nullptr;
+}
+
+void MemoCache::insert(uint32_t fn, const uint64_t* a, size_t n, size_t h, double result){
+    size_t mask = table.size()-1;
+    Entry* victim = nullptr;
+    for(size_t w=0;w<WAYS && !victim;++w){ Entry& e = table[(h+w) & mask]; if(!e.fn){ victim = &e; ++entries; } }
+    // reloj: cada ranura usada tiene una segunda oportunidad; si todas la gastan, se sustituye la primera
+    for(size_t w=0;w<WAYS && !victim;++w){ Entry& e = table[(h+w) & mask]; if(e.used) e.used = 0; else victim = &e; }
+    if(!victim) victim = &table[h & mask];
+    if(victim->fn) ++evictions;
+    copy(a, a+n, victim->args); victim->result = result; victim->fn = fn; victim->n = (uint8_t)n; victim->used = 0;
+}
+
+double* memoCall(const Instr& in, double* sp, const double* vars){
+    size_t n = in.fn==0 ? 1 : in.fn==1 ? 2 : in.uf->nargs;
+    double* args = sp+1-n;
+    uint64_t bits[MemoCache::MAX_ARGS];
+    memcpy(bits, args, n*sizeof(double));
+    MemoCache& M = memoCache();
+    size_t h = memoHash(in.arg, bits, n);
+    double r;
+    if(const double* hit = M.find(in.arg, bits, n, h)){ ++M.hits; r = *hit; }
+    else {
+        ++M.misses;
+        r = in.fn==0 ? in.f1(args[0]) : in.fn==1 ? in.f2(args[0], args[1]) : runProgram(in.uf->body, vars, args);
+        M.insert(in.arg, bits, n, h, r);
+    }
+    sp -= n; *++sp = r;
+    return sp;
+}
+
+void memoizeCalls(Program& p){
+    for(Instr& in: p.code){
+        Instr m(Op::Memo);
+        if(in.op==Op::Call1){
+            F1 id = (F1)in.fn; // las baratas cuestan menos que buscarlas
+            if(id==F1::Abs || id==F1::Floor || id==F1::Ceil || id==F1::Round || id==F1::Sqrt) continue;
+            m.fn = 0; m.arg = MEMO_F1 + in.fn; m.f1 = in.f1;
+        }
+        else if(in.op==Op::Call2){ m.fn = 1; m.arg = MEMO_F2 + in.fn; m.f2 = in.f2; }
+        else if(in.op==Op::CallU && in.uf->pure && in.uf->nargs<=MemoCache::MAX_ARGS){ m.fn = 2; m.arg = MEMO_USER + in.uf->id; m.uf = in.uf; }
+        else continue;
+        in = m;
+    }
+}
+
+// --- Definiciones reactivas ---
+static void unlinkFormula(Env& env, uint32_t slot){
+    auto it = env.formulas.find(slot);
+    if(it==env.formulas.end()) return;
+    for(uint32_t d: it->second.deps){
+        auto& v = env.dependents[d];
+        v.erase(remove(v.begin(), v.end(), slot), v.end());
+    }
+    env.formulas.erase(it);
+}
+
+// Una fórmula sin entradas pendientes; 'err' recibe su error, si lo hay.
+static void recalcOne(Env& env, uint32_t f, CalcError& err){
+    try{ env.vals[f] = runProgram(*env.formulas.find(f)->second.prog, env.vals.data()); }
+    catch(const CalcError& ex){ env.vals[f] = NAN; err = CalcError(ex.code, env.names[f] + ": " + ex.what()); }
+    catch(const exception& ex){ env.vals[f] = NAN; err = CalcError(ErrCode::Unsupported, env.names[f] + ": " + ex.what()); }
+}
+
+// Recalcula las fórmulas alcanzables desde 'root', que ya tiene su valor nuevo.
+static void recalcFrom(Env& env, uint32_t root){
+    env.recalcErrors.clear();
+    if(root>=env.dependents.size() || env.dependents[root].empty()) return;
+    const size_t PAR_MIN = 512, PAR_GRAIN = 64; // por debajo, repartir cuesta más que evaluar
+    vector<char> seen(env.vals.size(), 0); seen[root] = 1;
+    vector<uint32_t> affected, stack{root};
+    while(!stack.empty()){
+        uint32_t s = stack.back(); stack.pop_back();
+        for(uint32_t d: env.dependents[s]) if(!seen[d]){ seen[d] = 1; affected.push_back(d); stack.push_back(d); }
+    }
+    // Kahn por niveles: pending[f] = entradas de f que aún hay que recalcular
+    vector<uint32_t> pending(env.vals.size(), 0), level, next;
+    for(uint32_t f: affected){
+        for(uint32_t d: env.formulas.find(f)->second.deps) if(seen[d] && d!=root) ++pending[f];
+        if(!pending[f]) level.push_back(f);
+    }
+    const CalcError none(ErrCode{}, string());
+    vector<CalcError> errs;
+    while(!level.empty()){
+        errs.assign(level.size(), none);
+        if(env.recalcPool && level.size()>=PAR_MIN)
+            env.recalcPool->parallelFor(level.size(), PAR_GRAIN, [&](size_t b, size_t e){
+                for(size_t i=b;i<e;++i) recalcOne(env, level[i], errs[i]);
+            });
+        else for(size_t i=0;i<level.size();++i) recalcOne(env, level[i], errs[i]);
+        for(auto& e: errs) if(e.code!=ErrCode{}) env.recalcErrors.push_back(move(e));
+        next.clear();
+        for(uint32_t f: level) for(uint32_t d: env.dependents[f]) if(--pending[d]==0) next.push_back(d);
+        swap(level, next);
+    }
+}
+
+void onAssigned(Env& env, uint32_t slot){
+    unlinkFormula(env, slot);
+    recalcFrom(env, slot);
+}
+
+double defineFormula(Env& env, const string& name, string_view src){
+    if(UF.count(name) || BF.count(name)) throw CalcError(ErrCode::Syntax, "Asignación inválida. Usa: nombre := expresión");
+    Program p = compileUnfolded(toRPN(src), env);
+    if(!p.target.empty()) throw CalcError(ErrCode::Syntax, "Asignación inválida. Usa: nombre := expresión");
+    requireScalar(p, env, name.c_str());
+
+    uint32_t slot = env.intern(name);
+    vector<uint32_t> deps = p.reads;
+    if(env.dependents.size() < env.vals.size()) env.dependents.resize(env.vals.size());
+    // ciclo: alguna entrada es la propia variable o depende de ella
+    vector<char> down(env.vals.size(), 0); vector<uint32_t> stack{slot}; down[slot] = 1;
+    while(!stack.empty()){
+        uint32_t s = stack.back(); stack.pop_back();
+        for(uint32_t d: env.dependents[s]) if(!down[d]){ down[d] = 1; stack.push_back(d); }
+    }
+    for(uint32_t d: deps) if(down[d]) throw CalcError(ErrCode::Unsupported, "Dependencia circular: "+name+" depende de sí misma");
+
+    double v = runProgram(p, env.vals.data());
+    unlinkFormula(env, slot);
+    for(uint32_t d: deps) env.dependents[d].push_back(slot);
+    env.formulas[slot] = {make_shared<const Program>(move(p)), move(deps), string(src)};
+    env.vals[slot] = v; env.defined[slot] = 1; env.vectors.erase(slot);
+    recalcFrom(env, slot);
+    return v;
+}
+
+bool defineLine(string_view line, Env& env, ExprCache& cache, string& out, bool batch){
+    Lexer L(line);
+    Token name = L.next();
+    if(name.t!=TokType::Ident || L.next().t!=TokType::Define) return false;
+    string n(name.text);
+    double v = defineFormula(env, n, trimView(line.substr(L.i)));
+    if(env.consts.erase(n)) cache.clear();
+    if(!batch) out.append("[ok] ").append(n).append(" := ");
+    appendNumber(out, v, env.format, env.precision);
+    return true;
+}
+
+// --- Derivación automática en modo directo ---
+double derivF1(F1 id, double x){
+    switch(id){
+        case F1::Sin: return cos(x);
+        case F1::Cos: return -sin(x);
+        case F1::Tan: { double c = cos(x); return 1.0/(c*c); }
+        case F1::Asin: return 1.0/sqrt(1.0-x*x);
+        case F1::Acos: return -1.0/sqrt(1.0-x*x);
+        case F1::Atan: return 1.0/(1.0+x*x);
+        case F1::Sqrt: return 0.5/sqrt(x);
+        case F1::Cbrt: { double c = cbrt(x); return 1.0/(3.0*c*c); }
+        case F1::Exp: return exp(x);
+        case F1::Abs: return x>0 ? 1.0 : x<0 ? -1.0 : 0.0;
+        case F1::Floor: case F1::Ceil: case F1::Round: return 0.0;
+        case F1::Ln: return 1.0/x;
+        case F1::Log10: return 1.0/(x*log(10.0));
+    }
+    return NAN;
+}
+
+// d(a^b) = b·a^(b-1)·da + a^b·ln(a)·db; cada término solo cuenta si su
+// diferencial no es nulo, para que x^3 con x<0 no arrastre el NaN de ln(x).
+static void powTangent(double a, double b, double r, const double* da, const double* db, double* o, size_t k){
+    double ca = b==0.0 ? 0.0 : b*pow(a, b-1.0), cb = r*log(a);
+    for(size_t j=0;j<k;++j) o[j] = (da[j]!=0.0 ? ca*da[j] : 0.0) + (db[j]!=0.0 ? cb*db[j] : 0.0);
+}
+
+double runProgramDual(const Program& prog, const double* vars, const uint32_t* seeds, size_t k, double* d){
+    const Program& p = flatProgram(prog);
+    thread_local vector<double> val, dot; // pila de valores y de tangentes (k por entrada)
+    if(val.size() < p.maxDepth) val.resize(p.maxDepth);
+    if(dot.size() < p.maxDepth*k) dot.resize(p.maxDepth*k);
+    size_t sp = 0; // entradas en la pila
+    auto T = [&](size_t i){ return dot.data()+i*k; };
+    // regla de la cadena t·c con 0·c = 0 aunque c sea inf o NaN: una variable que no
+    // depende de la semilla no debe contaminar la derivada
+    auto scale = [](double t, double c){ return t!=0.0 ? t*c : 0.0; };
+    for(const Instr* ip = p.code.data(); ; ++ip){
+        switch(ip->op){
+            case Op::Num: val[sp] = ip->num; fill(T(sp), T(sp)+k, 0.0); ++sp; break;
+            case Op::Var:
+                val[sp] = vars[ip->arg];
+                for(size_t j=0;j<k;++j) T(sp)[j] = seeds[j]==ip->arg ? 1.0 : 0.0;
+                ++sp; break;
+            case Op::Neg: val[sp-1] = -val[sp-1]; for(size_t j=0;j<k;++j) T(sp-1)[j] = -T(sp-1)[j]; break;
+            case Op::Sqr: {
+                double a = val[sp-1], c = 2.0*a;
+                val[sp-1] = a*a; for(size_t j=0;j<k;++j) T(sp-1)[j] = scale(T(sp-1)[j], c);
+                break;
+            }
+            case Op::PowI: {
+                int n = (int32_t)ip->arg; double a = val[sp-1], c = n * powi(a, n-1);
+                val[sp-1] = powi(a, n); for(size_t j=0;j<k;++j) T(sp-1)[j] = scale(T(sp-1)[j], c);
+                break;
+            }
+            case Op::Call1: {
+                double a = val[sp-1], c = derivF1((F1)ip->fn, a);
+                val[sp-1] = ip->f1(a);
+                for(size_t j=0;j<k;++j) T(sp-1)[j] = scale(T(sp-1)[j], c);
+                break;
+            }
+            case Op::Ret: copy(T(0), T(0)+k, d); return val[0];
+            default: { // Add, Sub, Mul, Div, Pow y Call2 (pow)
+                --sp;
+                double a = val[sp-1], b = val[sp], *ta = T(sp-1), *tb = T(sp);
+                switch(ip->op){
+                    case Op::Add: val[sp-1] = a+b; for(size_t j=0;j<k;++j) ta[j] += tb[j]; break;
+                    case Op::Sub: val[sp-1] = a-b; for(size_t j=0;j<k;++j) ta[j] -= tb[j]; break;
+                    case Op::Mul: val[sp-1] = a*b; for(size_t j=0;j<k;++j) ta[j] = scale(ta[j], b) + scale(tb[j], a); break;
+                    case Op::Div: {
+                        if(b==0.0) throw CalcError(ErrCode::DivisionByZero, "División por cero");
+                        double r = a/b; val[sp-1] = r;
+                        for(size_t j=0;j<k;++j) ta[j] = (ta[j] - scale(tb[j], r))/b;
+                        break;
+                    }
+                    default: { // Pow y Call2: F2::Pow es la única binaria
+                        double r = ip->op==Op::Pow ? pow(a,b) : ip->f2(a,b);
+                        val[sp-1] = r; powTangent(a, b, r, ta, tb, ta, k);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Parte 'text' por las comas de primer nivel (fuera de paréntesis).
+static void splitArgs(string_view text, vector<string_view>& args){
+    int depth = 0; size_t from = 0;
+    for(size_t i=0;i<text.size();++i){
+        if(text[i]=='(') ++depth;
+        else if(text[i]==')' && --depth<0) throw CalcError(ErrCode::Syntax, "Paréntesis desbalanceados");
+        else if(text[i]==',' && depth==0){ args.push_back(trimView(text.substr(from, i-from))); from = i+1; }
+    }
+    args.push_back(trimView(text.substr(from)));
+}
+
+// Reconoce una línea `nombre(arg, arg...)` y la parte por las comas de primer
+// nivel. false si la línea no empieza por nombre seguido de '('.
+static bool callArgs(string_view line, string_view name, vector<string_view>& args, const char* usage){
+    if(line.size()<=name.size() || line.compare(0, name.size(), name)!=0) return false;
+    string_view rest = trimView(line.substr(name.size()));
+    if(rest.empty() || rest.front()!='(') return false; // p. ej. una variable llamada diffx
+    if(rest.back()!=')') throw CalcError(ErrCode::Syntax, usage);
+    splitArgs(rest.substr(1, rest.size()-2), args);
+    return true;
+}
+
+// "valor, d/dx = ..., d/dy = ..."
+static void appendPartials(string& out, const Env& env, double v, const vector<string>& names, const double* d){
+    appendNumber(out, v, env.format, env.precision);
+    for(size_t j=0;j<names.size();++j){
+        out.append(", d/d").append(names[j]).append(" = ");
+        appendNumber(out, d[j], env.format, env.precision);
+    }
+}
+
+bool diffLine(string_view line, Env& env, string& out){
+    static const char* const usage = "Uso: diff(expresión, variable[, variable...])";
+    vector<string_view> args;
+    if(!callArgs(line, "diff", args, usage)) return false;
+    if(args.size()<2) throw CalcError(ErrCode::Arity, usage);
+
+    vector<string> names;
+    for(size_t i=1;i<args.size();++i){
+        Lexer L(args[i]); Token t = L.next();
+        if(t.t!=TokType::Ident || L.next().t!=TokType::End)
+            throw CalcError(ErrCode::Syntax, "diff: se esperaba un nombre de variable y no '"+string(args[i])+"'");
+        names.emplace_back(t.text);
+    }
+    // las semillas no se pliegan como constantes aunque sean pi o e
+    vector<string> unfolded;
+    for(auto& n: names) if(env.consts.erase(n)) unfolded.push_back(n);
+    Program p;
+    try{ p = compileRPN(toRPN(args[0]), env); }
+    catch(...){ for(auto& n: unfolded) env.consts.insert(n); throw; }
+    for(auto& n: unfolded) env.consts.insert(n);
+    if(!p.target.empty()) throw CalcError(ErrCode::Unsupported, "diff no admite asignaciones");
+    requireScalar(p, env, "diff");
+
+    vector<uint32_t> seeds; for(auto& n: names) seeds.push_back(env.intern(n));
+    vector<double> d(seeds.size());
+    double v = runProgramDual(p, env.vals.data(), seeds.data(), seeds.size(), d.data());
+    appendPartials(out, env, v, names, d.data());
+    return true;
+}
+
+// --- Derivación automática en modo inverso ---
+void GradTape::bind(const Program& prog){
+    const Program& p = flatProgram(prog);
+    size_t n = p.code.size();
+    a.assign(n, 0); b.assign(n, 0); active.assign(n, 0);
+    val.resize(n); adj.resize(n); slots.clear();
+    vector<uint32_t> stack; stack.reserve(p.maxDepth); // índices de instrucción
+    for(uint32_t i=0;i<n;++i){
+        const Instr& in = p.code[i];
+        switch(in.op){
+            case Op::Num: stack.push_back(i); break;
+            case Op::Var:
+                active[i] = 1; stack.push_back(i);
+                if(find(slots.begin(), slots.end(), in.arg)==slots.end()) slots.push_back(in.arg);
+                break;
+            case Op::Neg: case Op::Sqr: case Op::PowI: case Op::Call1:
+                a[i] = stack.back(); stack.back() = i; active[i] = active[a[i]]; break;
+            case Op::Ret: a[i] = stack.back(); break;
+            case Op::Arg: case Op::CallU: case Op::Memo: break; // flatProgram no las tiene
+            default:
+                b[i] = stack.back(); stack.pop_back();
+                a[i] = stack.back(); stack.back() = i;
+                active[i] = active[a[i]] | active[b[i]];
+        }
+    }
+}
+
+double GradTape::forward(const Program& prog, const double* vars){
+    const Program& p = flatProgram(prog);
+    const Instr* code = p.code.data();
+    for(size_t i=0;;++i){
+        const Instr& in = code[i];
+        switch(in.op){
+            case Op::Num: val[i] = in.num; break;
+            case Op::Var: val[i] = vars[in.arg]; break;
+            case Op::Neg: val[i] = -val[a[i]]; break;
+            case Op::Sqr: val[i] = val[a[i]]*val[a[i]]; break;
+            case Op::PowI: val[i] = powi(val[a[i]], (int32_t)in.arg); break;
+            case Op::Call1: val[i] = in.f1(val[a[i]]); break;
+            case Op::Add: val[i] = val[a[i]] + val[b[i]]; break;
+            case Op::Sub: val[i] = val[a[i]] - val[b[i]]; break;
+            case Op::Mul: val[i] = val[a[i]] * val[b[i]]; break;
+            case Op::Div:
+                if(val[b[i]]==0.0) throw CalcError(ErrCode::DivisionByZero, "División por cero");
+                val[i] = val[a[i]] / val[b[i]]; break;
+            case Op::Pow: val[i] = pow(val[a[i]], val[b[i]]); break;
+            case Op::Call2: val[i] = in.f2(val[a[i]], val[b[i]]); break;
+            case Op::Arg: case Op::CallU: case Op::Memo: break;
+            case Op::Ret: return val[a[i]];
+        }
+    }
+}
+
+void GradTape::backward(const Program& prog, double* grad){
+    const Program& p = flatProgram(prog);
+    size_t n = p.code.size();
+    fill(adj.begin(), adj.begin()+n, 0.0);
+    adj[a[n-1]] = 1.0; // Ret
+    // las adjuntas nulas se saltan: 0·c = 0 aunque c sea inf o NaN, como en el modo directo
+    auto add = [this](uint32_t to, double g, double c){ if(active[to]) adj[to] += g*c; };
+    for(size_t i=n-1; i-- > 0;){
+        double g = adj[i];
+        if(g==0.0 || !active[i]) continue;
+        const Instr& in = p.code[i];
+        double x = val[a[i]];
+        switch(in.op){
+            case Op::Num: break;
+            case Op::Var: grad[in.arg] += g; break;
+            case Op::Neg: adj[a[i]] -= g; break;
+            case Op::Sqr: add(a[i], g, 2.0*x); break;
+            case Op::PowI: { int k = (int32_t)in.arg; add(a[i], g, k*powi(x, k-1)); break; }
+            case Op::Call1: add(a[i], g, derivF1((F1)in.fn, x)); break;
+            case Op::Add: add(a[i], g, 1.0); add(b[i], g, 1.0); break;
+            case Op::Sub: add(a[i], g, 1.0); add(b[i], g, -1.0); break;
+            case Op::Mul: add(a[i], g, val[b[i]]); add(b[i], g, x); break;
+            case Op::Div: add(a[i], g, 1.0/val[b[i]]); add(b[i], g, -val[i]/val[b[i]]); break;
+            case Op::Pow: case Op::Call2: { // F2::Pow es la única binaria
+                double y = val[b[i]];
+                if(y!=0.0) add(a[i], g, y*pow(x, y-1.0));
+                add(b[i], g, val[i]*log(x));
+                break;
+            }
+            case Op::Arg: case Op::CallU: case Op::Memo: case Op::Ret: break;
+        }
+    }
+}
+
+bool gradLine(string_view line, Env& env, string& out){
+    static const char* const usage = "Uso: grad(expresión)";
+    vector<string_view> args;
+    if(!callArgs(line, "grad", args, usage)) return false;
+    if(args.size()!=1) throw CalcError(ErrCode::Arity, usage);
+    Program p = compileRPN(toRPN(args[0]), env);
+    if(!p.target.empty()) throw CalcError(ErrCode::Unsupported, "grad no admite asignaciones");
+    requireScalar(p, env, "grad");
+    thread_local GradTape t; thread_local vector<double> g;
+    t.bind(p);
+    g.assign(env.vals.size(), 0.0);
+    double v = t.forward(p, env.vals.data());
+    t.backward(p, g.data());
+    vector<string> names; vector<double> d;
+    for(uint32_t s: t.slots){ names.push_back(env.names[s]); d.push_back(g[s]); }
+    appendPartials(out, env, v, names, d.data());
+    return true;
+}
+
+// --- Evaluación por columnas ---
+void mapF1(F1 id, const double* a, double* o, size_t n){
+    const SimdKernels& K = simdKernels();
+    switch(id){
+        case F1::Sin: K.sin(a,o,n); return;     case F1::Cos: K.cos(a,o,n); return;     case F1::Tan: K.tan(a,o,n); return;
+        case F1::Sqrt: K.sqrt(a,o,n); return;   case F1::Cbrt: K.cbrt(a,o,n); return;   case F1::Exp: K.exp(a,o,n); return;
+        case F1::Abs: K.abs(a,o,n); return;     case F1::Floor: K.floor(a,o,n); return; case F1::Ceil: K.ceil(a,o,n); return;
+        case F1::Round: K.round(a,o,n); return; case F1::Ln: K.ln(a,o,n); return;       case F1::Log10: K.log10(a,o,n); return;
+        case F1::Asin: for(size_t i=0;i<n;++i) o[i]=asin(a[i]); return;
+        case F1::Acos: for(size_t i=0;i<n;++i) o[i]=acos(a[i]); return;
+        case F1::Atan: for(size_t i=0;i<n;++i) o[i]=atan(a[i]); return;
+    }
+}
+
+void mapBinary(Op op, const double* a, double sa, const double* b, double sb, double* o, size_t n, size_t row0){
+    const SimdKernels& K = simdKernels();
+    if(op==Op::Div){
+        if(!b){ if(sb==0.0) throw CalcError(ErrCode::DivisionByZero, "División por cero"); }
+        else {
+            bool zero=false;
+            for(size_t i=0;i<n;++i) zero |= (b[i]==0.0);
+            if(zero){
+                size_t i=0; while(b[i]!=0.0) ++i;
+                throw CalcError(ErrCode::DivisionByZero, "División por cero (fila "+to_string(row0+i+1)+")");
+            }
+        }
+    }
+    switch(op){
+        case Op::Add: if(!a) K.adds(b,sa,o,n); else if(!b) K.adds(a,sb,o,n); else K.add(a,b,o,n); return;
+        case Op::Mul: if(!a) K.muls(b,sa,o,n); else if(!b) K.muls(a,sb,o,n); else K.mul(a,b,o,n); return;
+        case Op::Sub: if(!a) K.rsub(sa,b,o,n); else if(!b) K.subs(a,sb,o,n); else K.sub(a,b,o,n); return;
+        case Op::Div: if(!a) K.rdiv(sa,b,o,n); else if(!b) K.divs(a,sb,o,n); else K.div(a,b,o,n); return;
+        case Op::Pow: if(!a) K.rpow(sa,b,o,n); else if(!b) K.pows(a,sb,o,n); else K.pow(a,b,o,n); return;
+        default: throw CalcError(ErrCode::Unsupported, "Operador no soportado en modo columnas");
+    }
+}
+
+void mapPowI(const double* a, int k, double* o, double* base, size_t n){
+    const SimdKernels& K = simdKernels();
+    unsigned m = k<0 ? 0u-(unsigned)k : (unsigned)k;
+    copy(a, a+n, base);
+    for(bool first = true; m; m >>= 1){
+        if(m & 1){ if(first) copy(base, base+n, o); else K.mul(o, base, o, n); first = false; }
+        if(m > 1) K.mul(base, base, base, n);
+    }
+    if(k<0) K.rdiv(1.0, o, o, n);
+}
+
+void evalColumnRange(const Program& prog, const Env& env, const vector<const double*>& colOf, size_t r0, size_t r1, double* out,
+                     size_t rowBase){
+    const Program& p = flatProgram(prog);
+    struct Slot { const double* ptr; double s; bool vec; };
+    thread_local vector<double> scratch; thread_local vector<Slot> st;
+    if(scratch.size() < (p.maxDepth+1)*BATCH_BLOCK) scratch.resize((p.maxDepth+1)*BATCH_BLOCK); // +1: bloque auxiliar de PowI
+    if(st.size() < p.maxDepth) st.resize(p.maxDepth);
+
+    for(; r0<r1; r0+=BATCH_BLOCK){
+        size_t n = min(BATCH_BLOCK, r1-r0);
+        size_t sp = 0; // número de entradas en la pila
+        // el resultado de la profundidad 0 se escribe directamente en 'out'
+        auto dst = [&](size_t d){ return d==0 ? out+r0 : scratch.data()+d*BATCH_BLOCK; };
+        for(const Instr* ip = p.code.data(); ip->op!=Op::Ret; ++ip){
+            switch(ip->op){
+                case Op::Num: st[sp++] = {nullptr, ip->num, false}; break;
+                case Op::Var:
+                    if(colOf[ip->arg]) st[sp++] = {colOf[ip->arg]+r0, 0, true};
+                    else st[sp++] = {nullptr, env.vals[ip->arg], false};
+                    break;
+                case Op::Neg: {
+                    Slot& a = st[sp-1];
+                    if(!a.vec){ a.s = -a.s; break; }
+                    double* o = dst(sp-1);
+                    simdKernels().neg(a.ptr, o, n);
+                    a.ptr = o; break;
+                }
+                case Op::Sqr: case Op::PowI: {
+                    Slot& a = st[sp-1];
+                    if(!a.vec){ a.s = ip->op==Op::Sqr ? a.s*a.s : powi(a.s, (int32_t)ip->arg); break; }
+                    double* o = dst(sp-1);
+                    if(ip->op==Op::Sqr) simdKernels().mul(a.ptr, a.ptr, o, n);
+                    else mapPowI(a.ptr, (int32_t)ip->arg, o, scratch.data()+p.maxDepth*BATCH_BLOCK, n);
+                    a.ptr = o; break;
+                }
+                case Op::Call1: {
+                    Slot& a = st[sp-1];
+                    if(!a.vec){ a.s = ip->f1(a.s); break; }
+                    double* o = dst(sp-1);
+                    mapF1((F1)ip->fn, a.ptr, o, n);
+                    a.ptr = o; break;
+                }
+                default: { // binarios: Add, Sub, Mul, Div, Pow y Call2 (pow)
+                    Slot& a = st[sp-2]; Slot& b = st[sp-1]; --sp;
+                    Op op = ip->op==Op::Call2 ? Op::Pow : ip->op; // F2::Pow es la única binaria
+                    if(!a.vec && !b.vec){
+                        if(op==Op::Div && b.s==0.0) throw CalcError(ErrCode::DivisionByZero, "División por cero");
+                        a.s = op==Op::Add ? a.s+b.s : op==Op::Sub ? a.s-b.s : op==Op::Mul ? a.s*b.s : op==Op::Div ? a.s/b.s : pow(a.s,b.s);
+                        break;
+                    }
+                    double* o = dst(sp-1);
+                    mapBinary(op, a.vec?a.ptr:nullptr, a.s, b.vec?b.ptr:nullptr, b.s, o, n, rowBase+r0);
+                    a = {o, 0, true}; break;
+                }
+            }
+        }
+        if(!st[0].vec) fill(out+r0, out+r0+n, st[0].s);
+        else if(st[0].ptr != out+r0) copy(st[0].ptr, st[0].ptr+n, out+r0);
+    }
+}
+
+// Columna de cada ranura que lee p (nullptr: se usa el valor escalar de env).
+static vector<const double*> bindColumns(const Program& p, const Env& env, const vector<ColumnBinding>& cols){
+    if(!p.target.empty()) throw CalcError(ErrCode::Unsupported, "La evaluación por columnas no admite asignaciones");
+    vector<const double*> colOf(env.vals.size(), nullptr); // por ranura
+    for(auto& in: flatProgram(p).code){
+        if(in.op!=Op::Var || colOf[in.arg]) continue;
+        for(auto& c: cols) if(c.name==env.names[in.arg]){ colOf[in.arg] = c.data; break; }
+        if(!colOf[in.arg] && !env.defined[in.arg]) throw CalcError(ErrCode::UnknownVariable, "Variable no definida: "+env.names[in.arg]);
+        if(!colOf[in.arg] && env.vectors.count(in.arg))
+            throw CalcError(ErrCode::Unsupported, env.names[in.arg]+" es un vector y aquí solo se admiten escalares");
+    }
+    return colOf;
+}
+
+// Filas [0, rows) con las columnas ya resueltas, repartidas entre los hilos de pool.
+static void evalColumnsOf(const Program& p, const Env& env, const vector<const double*>& colOf, size_t rows, double* out,
+                          WorkPool* pool, size_t grain){
+    if(!pool || pool->threads()==1){ evalColumnRange(p, env, colOf, 0, rows, out); return; }
+    size_t blocks = (rows + BATCH_BLOCK - 1) / BATCH_BLOCK;
+    pool->parallelFor(blocks, grain, [&](size_t b, size_t e){
+        evalColumnRange(p, env, colOf, b*BATCH_BLOCK, min(rows, e*BATCH_BLOCK), out);
+    });
+}
+
+void evalColumns(const Program& p, const Env& env, const vector<ColumnBinding>& cols, size_t rows, double* out,
+                 WorkPool* pool, size_t grain){
+    evalColumnsOf(p, env, bindColumns(p, env, cols), rows, out, pool, grain);
+}
+
+// Fila a fila: cada hilo lleva su cinta y su copia de las variables, así que
+// dentro del bucle no se reserva memoria.
+void gradColumns(const Program& p, const Env& env, const vector<ColumnBinding>& cols, size_t rows,
+                 const uint32_t* wrt, size_t k, double* out, double* const* grad, WorkPool* pool, size_t grain){
+    vector<const double*> colOf = bindColumns(p, env, cols);
+    auto range = [&](size_t r0, size_t r1){
+        thread_local GradTape t; thread_local vector<double> vars, g;
+        t.bind(p);
+        vars = env.vals; g.assign(env.vals.size(), 0.0);
+        for(size_t r=r0; r<r1; ++r){
+            for(uint32_t s: t.slots){ if(colOf[s]) vars[s] = colOf[s][r]; g[s] = 0.0; }
+            out[r] = t.forward(p, vars.data());
+            t.backward(p, g.data());
+            for(size_t j=0;j<k;++j) grad[j][r] = g[wrt[j]];
+        }
+    };
+    if(!pool || pool->threads()==1){ range(0, rows); return; }
+    size_t blocks = (rows + BATCH_BLOCK - 1) / BATCH_BLOCK;
+    pool->parallelFor(blocks, grain, [&](size_t b, size_t e){ range(b*BATCH_BLOCK, min(rows, e*BATCH_BLOCK)); });
+}
+
+// --- Barridos ---
+// Nombre de la variable de un barrido ('who': el comando, para los errores).
+static string loopVar(string_view var, const char* who){
+    Lexer L(var); Token t = L.next();
+    if(t.t!=TokType::Ident || L.next().t!=TokType::End)
+        throw CalcError(ErrCode::Syntax, string(who)+": se esperaba un nombre de variable y no '"+string(var)+"'");
+    return string(t.text);
+}
+
+// Compila la expresión de un barrido con la variable libre y guarda su ranura.
+static void compileLoop(Sweep& s, Env& env, string_view expr, const string& name){
+    // la variable del barrido no se pliega aunque sea pi o e
+    bool unfolded = env.consts.erase(name) > 0;
+    try{ s.prog = compileRPN(toRPN(expr), env, true); }
+    catch(...){ if(unfolded) env.consts.insert(name); throw; }
+    if(unfolded) env.consts.insert(name);
+    s.slot = env.intern(name);
+}
+
+static double constLimit(Env& env, string_view src){ return runProgram(compileRPN(toRPN(src), env), env.vals.data()); }
+
+Sweep parseSweep(Env& env, string_view expr, string_view var, string_view start, string_view stop, string_view step,
+                 string_view reduce){
+    string name = loopVar(var, "sweep");
+    Sweep s;
+    s.start = constLimit(env, start); s.step = constLimit(env, step);
+    double end = constLimit(env, stop);
+    s.reduce = Reduce::None;
+    if(!reduce.empty() && !parseReduce(reduce, s.reduce))
+        throw CalcError(ErrCode::Syntax, "sweep: reducción desconocida '"+string(reduce)+"' (sum, prod, min, max o mean)");
+    double k = (end - s.start)/s.step; // pasos hasta el fin
+    if(s.step==0.0 || !isfinite(k) || k < 0) throw CalcError(ErrCode::Unsupported, "sweep: el paso debe ser distinto de 0 y avanzar del inicio al fin");
+    if(k >= 1e15) throw CalcError(ErrCode::Unsupported, "sweep: demasiados puntos");
+    s.count = (size_t)floor(k + k*1e-12) + 1; // el fin cuenta aunque (fin-inicio)/paso quede a un ULP
+    compileLoop(s, env, expr, name);
+    return s;
+}
+
+Sweep parseRange(Env& env, Reduce reduce, string_view expr, string_view var, string_view a, string_view b){
+    static const char* const names[] = {"", "sum", "prod", "min", "max", "mean"};
+    const char* who = names[(size_t)reduce];
+    string name = loopVar(var, who);
+    Sweep s;
+    s.start = constLimit(env, a); s.step = 1.0; s.reduce = reduce;
+    double end = constLimit(env, b);
+    if(s.start!=nearbyint(s.start) || end!=nearbyint(end)) // también descarta inf y NaN
+        throw CalcError(ErrCode::Unsupported, string(who)+": los límites deben ser enteros");
+    if(end - s.start >= 1e15) throw CalcError(ErrCode::Unsupported, string(who)+": demasiados términos");
+    s.count = end < s.start ? 0 : (size_t)(end - s.start) + 1;
+    compileLoop(s, env, expr, name);
+    return s;
+}
+
+// Suma por parejas: el error crece con log n y no con n. La base suma en 8
+// acumuladores independientes, que el compilador puede vectorizar.
+static double pairwiseSum(const double* x, size_t n){
+    if(n > 256){
+        size_t h = n/2 & ~size_t(7);
+        return pairwiseSum(x, h) + pairwiseSum(x+h, n-h);
+    }
+    double a[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    size_t i = 0;
+    for(; i+8<=n; i+=8) for(size_t j=0;j<8;++j) a[j] += x[i+j];
+    double r = ((a[0]+a[1]) + (a[2]+a[3])) + ((a[4]+a[5]) + (a[6]+a[7]));
+    for(; i<n; ++i) r += x[i];
+    return r;
+}
+
+// Suma compensada de Neumaier para los parciales de cada bloque.
+struct CompensatedSum {
+    double s = 0, c = 0;
+    void add(double v){
+        double t = s + v;
+        c += fabs(s) >= fabs(v) ? (s - t) + v : (v - t) + s;
+        s = t;
+    }
+    double value() const { return isfinite(s) ? s + c : s; } // con inf, c es NaN
+};
+
+double runSweep(const Sweep& s, const Env& env, const function<void(string_view)>& emit, WorkPool* pool, size_t grain){
+    double dummy = 0;
+    vector<const double*> colOf = bindColumns(s.prog, env, {{env.names[s.slot], &dummy}});
+    const bool useX = colOf[s.slot]!=nullptr;
+    const bool lines = s.reduce==Reduce::None;
+    const size_t blocks = (s.count + BATCH_BLOCK - 1)/BATCH_BLOCK;
+    const size_t tasksPerWave = pool ? 4*size_t(pool->threads()) : 1;
+    const size_t wave = grain*tasksPerWave; // bloques por ronda
+    vector<string> text(lines ? tasksPerWave : 0);
+    vector<double> parts(lines ? 0 : min(wave, blocks)); // reducción de cada bloque
+    auto minNaN = [](double a, double v){ return v < a || isnan(v) ? v : a; }; // un NaN se queda
+    auto maxNaN = [](double a, double v){ return v > a || isnan(v) ? v : a; };
+    auto reduceBlock = [&](const double* y, size_t n){
+        double r;
+        switch(s.reduce){
+            case Reduce::Prod: r = 1; for(size_t i=0;i<n;++i) r *= y[i]; return r;
+            case Reduce::Min: r = INFINITY; for(size_t i=0;i<n;++i) r = minNaN(r, y[i]); return r;
+            case Reduce::Max: r = -INFINITY; for(size_t i=0;i<n;++i) r = maxNaN(r, y[i]); return r;
+            default: return pairwiseSum(y, n); // Sum y Mean
+        }
+    };
+    CompensatedSum sum; double prod = 1, lo = INFINITY, hi = -INFINITY;
+
+    for(size_t w0=0; w0<blocks; w0+=wave){
+        size_t wn = min(wave, blocks-w0);
+        auto body = [&](size_t b, size_t e){
+            thread_local vector<double> xs, ys; thread_local vector<const double*> cof;
+            xs.resize(BATCH_BLOCK); ys.resize(BATCH_BLOCK);
+            cof = colOf; if(useX) cof[s.slot] = xs.data();
+            string* t = lines ? &text[b/grain] : nullptr;
+            if(t) t->clear();
+            for(size_t k=b;k<e;++k){
+                size_t r0 = (w0+k)*BATCH_BLOCK, n = min(BATCH_BLOCK, s.count-r0);
+                for(size_t i=0;i<n;++i) xs[i] = s.start + (double)(r0+i)*s.step;
+                evalColumnRange(s.prog, env, cof, 0, n, ys.data(), r0);
+                if(t){
+                    for(size_t i=0;i<n;++i){ appendNumber(*t, ys[i], env.format, env.precision); t->push_back('\n'); }
+                    continue;
+                }
+                parts[k] = reduceBlock(ys.data(), n);
+            }
+        };
+        if(pool && pool->threads()>1) pool->parallelFor(wn, grain, body);
+        else for(size_t b=0;b<wn;b+=grain) body(b, min(wn, b+grain));
+        if(lines) for(size_t i=0; i*grain<wn; ++i) emit(text[i]);
+        else for(size_t k=0;k<wn;++k){ sum.add(parts[k]); prod *= parts[k]; lo = minNaN(lo, parts[k]); hi = maxNaN(hi, parts[k]); }
+    }
+    switch(s.reduce){
+        case Reduce::Sum: return sum.value();
+        case Reduce::Prod: return prod;
+        case Reduce::Mean: return sum.value()/(double)s.count;
+        case Reduce::Min: return lo;
+        case Reduce::Max: return hi;
+        case Reduce::None: break;
+    }
+    return NAN;
+}
+
+bool sweepLine(string_view line, Env& env, string& out, WorkPool* pool, const function<void(string_view)>& emit){
+    static const char* const usage = "Uso: sweep(expresión, variable, inicio, fin, paso[, sum|prod|min|max|mean])";
+    vector<string_view> args;
+    if(!callArgs(line, "sweep", args, usage)) return false;
+    if(args.size()<5 || args.size()>6) throw CalcError(ErrCode::Arity, usage);
+    Sweep s = parseSweep(env, args[0], args[1], args[2], args[3], args[4], args.size()==6 ? args[5] : string_view());
+    if(s.reduce==Reduce::None && emit){ runSweep(s, env, emit, pool); return true; }
+    if(s.reduce==Reduce::None && s.count > SWEEP_BUFFER_MAX)
+        throw CalcError(ErrCode::Unsupported, "sweep: más de "+to_string(SWEEP_BUFFER_MAX)+" puntos sin reducción; usa sum, min, max... o --sweep");
+    size_t mark = out.size();
+    double r;
+    try{ r = runSweep(s, env, [&](string_view t){ out.append(t); }, pool); }
+    catch(...){ out.resize(mark); throw; } // sin resultados a medias
+
+    if(s.reduce==Reduce::None) out.pop_back(); // el '\n' final lo pone quien llama
+    else appendNumber(out, r, env.format, env.precision);
+    return true;
+}
+
+bool reduceLine(string_view line, Env& env, string& out, WorkPool* pool){
+    static const struct { const char* name; Reduce r; const char* usage; } kinds[] = {
+        {"sum", Reduce::Sum, "Uso: sum(expresión, variable, inicio, fin)"},
+        {"prod", Reduce::Prod, "Uso: prod(expresión, variable, inicio, fin)"},
+        {"min", Reduce::Min, "Uso: min(expresión, variable, inicio, fin)"},
+        {"max", Reduce::Max, "Uso: max(expresión, variable, inicio, fin)"},
+    };
+    for(auto& k: kinds){
+        vector<string_view> args;
+        if(!callArgs(line, k.name, args, k.usage)) continue;
+        if(args.size()!=4){
+            if(env.funcs.count(k.name)) return false; // p. ej. max(a, b) definida por el usuario
+            throw CalcError(ErrCode::Arity, k.usage);
+        }
+        Sweep s = parseRange(env, k.r, args[0], args[1], args[2], args[3]);
+        appendNumber(out, runSweep(s, env, nullptr, pool), env.format, env.precision);
+        return true;
+    }
+    return false;
+}
+
+// --- Vectores ---
+bool readsVector(const Program& p, const Env& env){
+    if(env.vectors.empty()) return false;
+    for(uint32_t s: p.reads) if(env.vectors.count(s)) return true;
+    return false;
+}
+
+void requireScalar(const Program& p, const Env& env, const char* who){
+    if(env.vectors.empty()) return;
+    for(uint32_t s: p.reads)
+        if(env.vectors.count(s))
+            throw CalcError(ErrCode::Unsupported, string(who)+": "+env.names[s]+" es un vector y aquí solo se admiten escalares");
+}
+
+void assignVector(Env& env, uint32_t slot, shared_ptr<const Vector> v){
+    if(slot<env.dependents.size() && !env.dependents[slot].empty())
+        throw CalcError(ErrCode::Unsupported, env.names[slot]+" es una entrada de definiciones reactivas y no puede ser un vector");
+    env.vectors[slot] = move(v);
+    env.vals[slot] = NAN; env.defined[slot] = 1;
+    if(!env.formulas.empty()) onAssigned(env, slot); // deja de ser reactiva, si lo era
+}
+
+shared_ptr<const Vector> evalVector(const Program& prog, Env& env, WorkPool* pool){
+    const Program& p = flatProgram(prog);
+    shared_ptr<const Vector> r;
+    if(p.code.size()==2 && p.code[0].op==Op::Var){ // `w = v`: sin copiar
+        auto it = env.vectors.find(p.code[0].arg);
+        if(it!=env.vectors.end()) r = it->second;
+    }
+    if(!r){
+        vector<const double*> colOf(env.vals.size(), nullptr);
+        const Vector* first = nullptr;
+        for(auto& in: p.code){
+            if(in.op!=Op::Var) continue;
+            auto it = env.vectors.find(in.arg);
+            if(it==env.vectors.end()) continue;
+            if(!first) first = it->second.get();
+            else if(it->second->n != first->n)
+                throw CalcError(ErrCode::Unsupported, "Vectores de distinta longitud: "+to_string(first->n)+" y "+to_string(it->second->n));
+            colOf[in.arg] = it->second->data;
+        }
+        if(!first) throw CalcError(ErrCode::Unsupported, "La expresión no lee ningún vector");
+        auto v = make_shared<Vector>(first->n);
+        evalColumnsOf(p, env, colOf, v->n, v->data, pool, 16);
+        r = move(v);
+    }
+    if(!prog.target.empty()) assignVector(env, prog.targetSlot, r);
+    return r;
+}
+
+void appendVector(string& out, const Vector& v, NumFormat f, int precision){
+    const size_t SHOW = 16; // con más, los primeros y "... (n elementos)"
+    out.push_back('[');
+    for(size_t i=0; i<v.n && i<SHOW; ++i){
+        if(i) out.append(", ");
+        appendNumber(out, v.data[i], f, precision);
+    }
+    if(v.n > SHOW) out.append(", ... (").append(to_string(v.n)).append(" elementos)");
+    out.push_back(']');
+}
+
+bool vectorProgram(const Program& p, Env& env, string& out, WorkPool* pool){
+    if(!readsVector(p, env)) return false;
+    shared_ptr<const Vector> v = evalVector(p, env, pool);
+    appendVector(out, *v, env.format, env.precision);
+    return true;
+}
+
+// Números de un archivo de texto separados por espacios, comas, ';' o saltos de línea.
+static shared_ptr<const Vector> loadVector(const string& path){
+    FILE* f = fopen(path.c_str(), "rb");
+    if(!f) throw CalcError(ErrCode::Unsupported, "load: no se puede abrir "+path);
+    string text; char buf[1<<16]; size_t n;
+    while((n = fread(buf, 1, sizeof buf, f)) > 0) text.append(buf, n);
+    bool bad = ferror(f); fclose(f);
+    if(bad) throw CalcError(ErrCode::Unsupported, "load: fallo de lectura en "+path);
+    vector<double> vals;
+    auto sep = [](char c){ return isspace((unsigned char)c) || c==',' || c==';'; };
+    for(size_t i=0; i<text.size();){
+        if(sep(text[i])){ ++i; continue; }
+        size_t j = i; while(j<text.size() && !sep(text[j])) ++j;
+        vals.push_back(Lexer::parseNumber(string_view(text).substr(i, j-i)));
+        i = j;
+    }
+    auto v = make_shared<Vector>(vals.size());
+    copy(vals.begin(), vals.end(), v->data);
+    return v;
+}
+
+bool vectorLine(string_view line, Env& env, ExprCache& cache, string& out){
+    string_view rest = line; string name;
+    if(line.empty() || line[0]!='['){
+        Lexer L(line); Token t = L.next();
+        if(t.t!=TokType::Ident || L.next().t!=TokType::Assign) return false;
+        rest = trimView(line.substr(L.i));
+        if(rest.empty() || (rest[0]!='[' && rest.compare(0, 4, "load")!=0)) return false;
+        name = string(t.text);
+        if(UF.count(name) || BF.count(name)) throw CalcError(ErrCode::Syntax, "Asignación inválida. Usa: nombre = expresión");
+    }
+    shared_ptr<const Vector> v;
+    vector<string_view> args;
+    if(rest[0]=='['){
+        if(rest.back()!=']') throw CalcError(ErrCode::Syntax, "Falta ']' al final del vector");
+        string_view inner = trimView(rest.substr(1, rest.size()-2));
+        if(!inner.empty()) splitArgs(inner, args);
+        auto w = make_shared<Vector>(args.size());
+        for(size_t i=0;i<args.size();++i){
+            Program p = compileRPN(toRPN(args[i]), env);
+            if(!p.target.empty()) throw CalcError(ErrCode::Syntax, "Un elemento de un vector no puede ser una asignación");
+            requireScalar(p, env, "Un elemento de un vector");
+            w->data[i] = runProgram(p, env.vals.data());
+        }
+        v = move(w);
+    } else {
+        if(!callArgs(rest, "load", args, "Uso: nombre = load(archivo)")) return false; // p. ej. loadx = 3
+        if(args.size()!=1 || args[0].empty()) throw CalcError(ErrCode::Arity, "Uso: nombre = load(archivo)");
+        string_view path = args[0];
+        if(path.size()>=2 && path.front()=='"' && path.back()=='"') path = path.substr(1, path.size()-2);
+        v = loadVector(string(path));
+    }
+    if(!name.empty()){
+        assignVector(env, env.intern(name), v);
+        if(env.consts.erase(name)) cache.clear();
+    }
+    appendVector(out, *v, env.format, env.precision);
+    return true;
+}
+
+// --- Evaluación de una línea ---
+void batchLine(string_view line, Env& env, ExprCache& cache, string& out){
+    if(line.empty()){ out.push_back('\n'); return; }
+    if(line[0]==':'){ out.append("[error] Comando no disponible en modo batch: ").append(line).push_back('\n'); return; }
+    try{
+        if(vectorLine(line, env, cache, out) || functionLine(line, env, cache, out, true) || defineLine(line, env, cache, out, true) || diffLine(line, env, out) || gradLine(line, env, out)
+           || sweepLine(line, env, out) || reduceLine(line, env, out)){
+            out.push_back('\n'); return;
+        }
+        Program compiled;
+        const Program* prog = cache.find(line);
+        if(!prog){
+            string key(line);
+            compiled = compileRPN(toRPN(key), env);
+            prog = cache.put(key, compiled);
+            if(!prog) prog = &compiled;
+        }
+        if(!vectorProgram(*prog, env, out)) appendNumber(out, evalProgram(*prog, env), env.format, env.precision);
+        out.push_back('\n');
+        if(!prog->target.empty() && env.consts.erase(prog->target)) cache.clear();
+    }catch(const exception& ex){
+        out.append("[error] ").append(ex.what()).push_back('\n');
+    }
+}
+
+} // namespace supercalc::detail
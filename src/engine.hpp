@@ -0,0 +1,724 @@
+// --- Motor de SuperCalc: análisis, compilación a bytecode y evaluación ---
+// Cabecera interna de libsupercalc: la usan la propia biblioteca (engine.cpp,
+// supercalc.cpp), el ejecutable interactivo (main.cpp) y supercalc_bench. Lo que
+// está en el camino caliente (lexer, formato, intérprete) sigue inline aquí; el
+// análisis, la compilación y la evaluación por columnas viven en engine.cpp.
+// Quien embebe la calculadora usa supercalc.hpp.
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <list>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <cstdint>
+#include <cstdlib>
+#include <charconv>
+#include <atomic>
+#include <stdexcept>
+#include "simd.hpp"
+#include "pool.hpp"
+
+// Reservas de memoria hechas con operator new (alloc_count.cpp, solo en los
+// ejecutables); lo usan los benchmarks.
+extern std::atomic<uint64_t> g_allocs;
+
+// Todo el motor vive en supercalc::detail, así que no choca con los nombres del
+// programa que embebe la biblioteca (su propio Program, Lexer o WorkPool). Los
+// nombres de std se traen uno a uno y solo dentro de este espacio de nombres.
+namespace supercalc::detail {
+
+using std::string; using std::string_view; using std::to_string;
+using std::vector; using std::list; using std::unordered_map; using std::unordered_set;
+using std::shared_ptr; using std::unique_ptr; using std::make_shared; using std::function;
+using std::atomic; using std::exception; using std::runtime_error; using std::align_val_t;
+using std::move; using std::swap; using std::min; using std::max;
+using std::find; using std::find_if; using std::any_of; using std::all_of; using std::none_of;
+using std::fill; using std::copy; using std::equal; using std::remove; using std::sort;
+using std::from_chars; using std::to_chars; using std::errc; using std::chars_format;
+using std::sin; using std::cos; using std::tan; using std::asin; using std::acos; using std::atan;
+using std::sqrt; using std::cbrt; using std::exp; using std::log; using std::log10; using std::pow;
+using std::fabs; using std::floor; using std::ceil; using std::round; using std::nearbyint;
+using std::isnan; using std::isfinite; using std::signbit; using std::strtod;
+
+// Errores del motor. El mensaje es el que ve el usuario; el código lo usa la API
+// de la biblioteca para devolver un estado sin excepciones (supercalc::Status).
+enum class ErrCode : int { Syntax = 1, UnknownVariable, UnknownFunction, Arity, DivisionByZero, Unsupported };
+struct CalcError : runtime_error {
+    ErrCode code;
+    CalcError(ErrCode c, const string& msg): runtime_error(msg), code(c) {}
+};
+
+// --- Utilidades de string ---
+inline string ltrim(string s){ s.erase(s.begin(), find_if(s.begin(), s.end(), [](unsigned char c){return !isspace(c);})); return s; }
+inline string rtrim(string s){ s.erase(find_if(s.rbegin(), s.rend(), [](unsigned char c){return !isspace(c);} ).base(), s.end()); return s; }
+inline string trim(string s){ return ltrim(rtrim(s)); }
+inline string_view trimView(string_view s){
+    while(!s.empty() && isspace((unsigned char)s.front())) s.remove_prefix(1);
+    while(!s.empty() && isspace((unsigned char)s.back())) s.remove_suffix(1);
+    return s;
+}
+
+// --- Tokenización ---
+// El lexer no copia la entrada: los tokens son vistas sobre el texto original
+// (que debe seguir vivo mientras se usen) y los números se leen con from_chars,
+// así que tokenizar no reserva memoria.
+enum class TokType { Number, Ident, LParen, RParen, Comma, Plus, Minus, Star, Slash, Caret, Assign, Define, End };
+struct Token{ TokType t; double value{}; string_view text; };
+
+struct Lexer {
+    string_view s; size_t i=0;
+    explicit Lexer(string_view src): s(src) {}
+
+    static bool isIdentStart(char c){ return isalpha((unsigned char)c) || c=='_'; }
+    static bool isIdentChar(char c){ return isalnum((unsigned char)c) || c=='_'; }
+
+    static double parseNumber(string_view lit){
+        double v = 0;
+        auto r = from_chars(lit.data(), lit.data()+lit.size(), v);
+        // fuera de rango: strtod da ±inf o 0 (from_chars no toca v)
+        if(r.ec==errc::result_out_of_range) return strtod(string(lit).c_str(), nullptr);
+        if(r.ec!=errc() || r.ptr!=lit.data()+lit.size()) throw CalcError(ErrCode::Syntax, "Número inválido: "+string(lit));
+        return v;
+    }
+
+    Token next(){
+        const size_t n = s.size();
+        while(i<n && isspace((unsigned char)s[i])) ++i;
+        if(i>=n) return {TokType::End, 0, {}};
+        const size_t start = i;
+        char c = s[i];
+        // números (incluye . y notación científica)
+        if (isdigit((unsigned char)c) || c=='.'){
+            bool seenDot = (c=='.');
+            ++i;
+            while(i<n && (isdigit((unsigned char)s[i]) || (!seenDot && s[i]=='.'))){ if(s[i]=='.') seenDot=true; ++i; }
+            // notación científica
+            if(i<n && (s[i]=='e' || s[i]=='E')){
+                size_t j=i+1; if(j<n && (s[j]=='+' || s[j]=='-')) ++j; bool any=false;
+                while(j<n && isdigit((unsigned char)s[j])){ any=true; ++j; }
+                if(any) i=j; // consume si es válido
+            }
+            string_view lit = s.substr(start, i-start);
+            return {TokType::Number, parseNumber(lit), lit};
+        }
+        if (isIdentStart(c)){
+            ++i; while(i<n && isIdentChar(s[i])) ++i;
+            return {TokType::Ident, 0.0, s.substr(start, i-start)};
+        }
+        ++i; // un solo char
+        TokType t;
+        switch(c){
+            case '(': t=TokType::LParen; break;
+            case ')': t=TokType::RParen; break;
+            case ',': t=TokType::Comma; break;
+            case '+': t=TokType::Plus; break;
+            case '-': t=TokType::Minus; break;
+            case '*': t=TokType::Star; break;
+            case '/': t=TokType::Slash; break;
+            case '^': t=TokType::Caret; break;
+            case '=': t=TokType::Assign; break;
+            case ':':
+                if(i<n && s[i]=='='){ ++i; return {TokType::Define, 0, s.substr(start, 2)}; } // :=
+                [[fallthrough]];
+            default: throw CalcError(ErrCode::Syntax, string("Símbolo inválido: ")+c);
+        }
+        return {t, 0, s.substr(start, 1)};
+    }
+};
+
+// --- Análisis sintáctico: precedencia de operadores en una sola pasada ---
+// Lee cada token una vez y emite la RPN directamente, con las llamadas a
+// función y sus listas de argumentos resueltas en el propio análisis. La pila
+// de operadores pendientes es explícita, así que el coste es lineal y la
+// profundidad de anidamiento no está limitada por la pila de C++.
+struct Node { // token para la RPN
+    enum Kind{KNum, KVar, KOp, KFunc, KAssign} k;
+    double val{}; string text; int argc{};
+};
+
+vector<Node> toRPN(string_view line);
+
+// --- Formato de resultados ---
+// Se escribe con to_chars: no depende del locale ni reserva memoria. Modos:
+//   fixed    -> :precision decimales (el de siempre)
+//   sci      -> notación científica con :precision decimales en la mantisa
+//   shortest -> el menor número de cifras que vuelve a leerse como el mismo double
+// Un double solo da 17 cifras significativas; en fixed y sci no se escriben más
+// (serían restos de la conversión binaria), así que con :precision alta pueden
+// salir menos decimales de los pedidos.
+enum class NumFormat : uint8_t { Fixed, Sci, Shortest };
+static const int MAX_SIG_DIGITS = 17;
+static const size_t NUM_BUF = 400; // fixed de 1e308 ocupa ~330 caracteres
+
+inline bool parseNumFormat(string_view s, NumFormat& f){
+    if(s=="fixed"){ f = NumFormat::Fixed; return true; }
+    if(s=="sci"){ f = NumFormat::Sci; return true; }
+    if(s=="shortest"){ f = NumFormat::Shortest; return true; }
+    return false;
+}
+inline const char* numFormatName(NumFormat f){ return f==NumFormat::Fixed ? "fixed" : f==NumFormat::Sci ? "sci" : "shortest"; }
+
+// Escribe v en buf (al menos NUM_BUF bytes) y devuelve la longitud.
+inline size_t formatNumber(char* buf, double v, NumFormat f, int precision){
+    static const double P10[] = {1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,1e12,1e13,1e14,1e15,1e16};
+    char* end = buf+NUM_BUF;
+    if(f==NumFormat::Shortest) return (size_t)(to_chars(buf, end, v).ptr - buf);
+    if(f==NumFormat::Sci) return (size_t)(to_chars(buf, end, v, chars_format::scientific, min(precision, MAX_SIG_DIGITS-1)).ptr - buf);
+    // con |v| < 10^k caben todos los decimales pedidos; solo fuera de ahí hace falta log10
+    int k = MAX_SIG_DIGITS-1-precision;
+    if(isfinite(v) && v!=0 && (k<0 || fabs(v) >= P10[k])){
+        int e = (int)floor(log10(fabs(v))); // posición de la primera cifra significativa
+        precision = max(0, min(precision, MAX_SIG_DIGITS-1-e));
+    }
+    return (size_t)(to_chars(buf, end, v, chars_format::fixed, precision).ptr - buf);
+}
+
+inline void appendNumber(string& out, double v, NumFormat f, int precision){
+    char buf[NUM_BUF];
+    out.append(buf, formatNumber(buf, v, f, precision));
+}
+
+// --- Entorno y tablas de funciones ---
+// Las variables se internan una vez en ranuras densas: el bytecode guarda el
+// índice y lee de 'vals', así que evaluar no calcula hashes y definir variables
+// nuevas no invalida los programas ya compilados. Los nombres solo se buscan al compilar.
+struct Program;
+
+struct UserFunc;
+
+// Valor vectorial de una variable: v = [1, 2, 3]. Los elementos son contiguos y
+// están alineados a ALIGN bytes para los núcleos SIMD. Un Vector no cambia una
+// vez creado: asignarlo a otra variable (o copiar Env para otro hilo) comparte
+// el bloque, y cada operación escribe su resultado en uno nuevo, así que solo se
+// copian datos al escribir.
+struct Vector {
+    static const size_t ALIGN = 64;
+    size_t n;
+    double* data;
+    explicit Vector(size_t count)
+        : n(count), data(static_cast<double*>(::operator new(max<size_t>(count, 1)*sizeof(double), align_val_t(ALIGN)))) {}
+    ~Vector(){ ::operator delete(data, align_val_t(ALIGN)); }
+    Vector(const Vector&) = delete;
+    Vector& operator=(const Vector&) = delete;
+};
+
+// Definición reactiva `nombre := expr`: se recalcula cuando cambia una de sus entradas.
+struct Formula {
+    shared_ptr<const Program> prog;
+    vector<uint32_t> deps; // ranuras que lee, sin repetir
+    string src;            // texto de la expresión, para :vars
+};
+
+struct Env{
+    vector<double> vals;               // valor por ranura
+    vector<string> names;              // nombre por ranura
+    vector<char> defined;              // la ranura tiene valor (puede existir sin él: destino o variable libre)
+    unordered_map<string,uint32_t> slotOf;
+    unordered_set<string> consts;      // variables que el compilador puede plegar (pi, e mientras no se reasignen)
+    int precision = 10;
+    NumFormat format = NumFormat::Fixed;
+    bool fastMath = false;             // permite reescrituras que no son exactas bit a bit (x^3, x^0.5...)
+    bool memo = false;                 // memoriza las llamadas a funciones puras (ver MemoCache)
+    // Grafo de dependencias de las definiciones reactivas.
+    unordered_map<uint32_t, Formula> formulas;  // por ranura definida con :=
+    vector<vector<uint32_t>> dependents;        // por ranura: fórmulas que la leen directamente
+    vector<CalcError> recalcErrors;             // fórmulas que fallaron en el último recálculo ("y: mensaje")
+    WorkPool* recalcPool = nullptr;             // hilos para recalcular ramas independientes (opcional)
+    unordered_map<string, shared_ptr<const UserFunc>> funcs; // funciones definidas con f(x, y) = ...
+    unordered_map<uint32_t, shared_ptr<const Vector>> vectors; // por ranura con valor vectorial (en vals, NaN)
+    Env(){ reset(); }
+    void reset(){
+        vals.clear(); names.clear(); defined.clear(); slotOf.clear();
+        formulas.clear(); dependents.clear(); recalcErrors.clear(); funcs.clear(); vectors.clear();
+        set("pi", acos(-1.0)); set("e", exp(1.0)); consts = {"pi", "e"};
+    }
+    uint32_t intern(const string& name){
+        auto it = slotOf.find(name);
+        if(it!=slotOf.end()) return it->second;
+        uint32_t s = (uint32_t)vals.size();
+        slotOf.emplace(name, s); vals.push_back(NAN); names.push_back(name); defined.push_back(0);
+        return s;
+    }
+    bool isDefined(const string& name) const { auto it = slotOf.find(name); return it!=slotOf.end() && defined[it->second]; }
+    void set(const string& name, double v){ uint32_t s = intern(name); vals[s] = v; defined[s] = 1; vectors.erase(s); }
+};
+
+using UFunc = double(*)(double);
+using BFunc = double(*)(double,double);
+
+// Identificadores estables de las funciones integradas (viajan en el bytecode).
+enum class F1 : uint8_t { Sin, Cos, Tan, Asin, Acos, Atan, Sqrt, Cbrt, Exp, Abs, Floor, Ceil, Round, Ln, Log10 };
+enum class F2 : uint8_t { Pow };
+struct UFEntry { F1 id; UFunc f; };
+struct BFEntry { F2 id; BFunc f; };
+
+extern const unordered_map<string,UFEntry> UF;
+extern const unordered_map<string,BFEntry> BF;
+
+// --- Bytecode: compilación de la RPN a instrucciones con opcodes enteros ---
+// Las funciones quedan resueltas a punteros y cada variable a su ranura: el índice
+// que le da Env::intern la primera vez que aparece, fijo hasta Env::reset, en
+// Env::vals (y names/defined). runProgram recibe vals.data() y Var lee vars[arg],
+// así que ejecutar un programa no compara cadenas ni calcula hashes.
+// Sqr y PowI salen de la reducción de fuerza de ^/pow con exponente constante.
+// Arg y CallU son de las funciones de usuario: Arg lee un argumento dentro del
+// cuerpo y CallU llama a un cuerpo que no se ha expandido en el sitio de la llamada.
+// Memo es una llamada memorizada (ver MemoCache).
+enum class Op : uint8_t { Num, Var, Neg, Add, Sub, Mul, Div, Pow, Sqr, PowI, Call1, Call2, Arg, CallU, Memo, Ret };
+
+struct Instr {
+    Op op; uint8_t fn = 0; // F1/F2 para Call1/Call2; Memo: 0 = F1, 1 = F2, 2 = función de usuario
+    uint32_t arg = 0;      // Var: ranura en Env; PowI: exponente (int32_t); Arg: índice del argumento;
+                           // Memo: identificador de la función en la caché
+    union { double num; UFunc f1; BFunc f2; const UserFunc* uf; };
+    Instr(Op o): op(o), num(0) {}
+};
+
+struct Program {
+    vector<Instr> code;       // siempre termina en Op::Ret
+    size_t maxDepth = 0;      // profundidad máxima de pila, calculada al compilar
+    string target;            // no vacío si la línea es `nombre = expr`
+    uint32_t targetSlot = 0;  // ranura de 'target' en Env
+    vector<shared_ptr<const UserFunc>> funcs; // cuerpos a los que apuntan las CallU (los mantiene vivos)
+    bool calls = false;                       // quedan CallU o Memo en 'code'
+    vector<uint32_t> reads;                   // ranuras que lee, sin repetir, también en los cuerpos que llama
+    shared_ptr<const Program> flat;           // 'code' con todas las llamadas expandidas y sin Memo
+};
+
+// --- Funciones de usuario: f(x, y) = x^2 + y ---
+// El cuerpo se compila una vez al definirla, con los parámetros como Arg y sin
+// plegar pi ni e, que lee como cualquier otra variable: si se reasignan, f ve el
+// valor nuevo (y deja de ser pura). Las llamadas se enlazan al compilar, así que
+// redefinir f no cambia lo ya compilado. Como el cuerpo solo puede llamar a
+// funciones ya definidas, no hay recursión.
+// En cada llamada, un cuerpo pequeño se copia en el programa que llama, con los
+// argumentos en lugar de los Arg, y se pliega junto con él; uno grande se llama
+// con CallU, que ejecuta el cuerpo sobre la pila del llamador sin reservar
+// memoria. Los argumentos de parámetros que el cuerpo no usa no se evalúan.
+// La derivación y la evaluación por columnas trabajan sobre Program::flat, que
+// expande todas las CallU (flatProgram).
+struct UserFunc {
+    string name, src;          // src: el cuerpo, para :vars
+    vector<string> params;
+    vector<int> argOf;         // por parámetro: índice de su Arg, o -1 si el cuerpo no lo usa
+    vector<uint32_t> uses;     // por Arg: cuántas veces lo lee el cuerpo
+    uint32_t nargs = 0;        // argumentos que recibe CallU (los parámetros usados)
+    bool pure = false;         // no lee variables de Env: con argumentos constantes se pliega
+    uint32_t id = 0;           // distinto en cada definición (clave de MemoCache)
+    Program body;
+};
+
+static const size_t INLINE_MAX = 16;      // instrucciones de un cuerpo que se expande en el sitio
+static const size_t FLAT_MAX = size_t(1)<<20; // tope de Program::flat
+
+// --- Memoización de llamadas a funciones puras ---
+// Con env.memo, las llamadas que quedan tras plegar se compilan a Memo: antes de
+// calcular se busca el resultado por (función, bits de los argumentos) en una
+// tabla de direccionamiento abierto de cada hilo. Una clave solo puede estar en
+// las WAYS ranuras que siguen a su hash; si están ocupadas se desaloja con el
+// algoritmo del reloj (la primera sin uso desde la última vuelta). Solo entran
+// funciones puras: las integradas caras (trigonométricas, exp, logaritmos, cbrt,
+// pow) y las de usuario que no leen variables, con hasta MAX_ARGS parámetros.
+// Se comparan bits, así que -0 y +0 son claves distintas y un NaN solo acierta
+// consigo mismo; una llamada que lanza un error no se guarda.
+struct MemoCache {
+    static const size_t WAYS = 8, MAX_ARGS = 4, DEFAULT_CAPACITY = 4096;
+    struct Entry { uint64_t args[MAX_ARGS]; double result; uint32_t fn; uint8_t n, used; }; // fn 0: libre
+    vector<Entry> table;
+    uint64_t hits = 0, misses = 0, evictions = 0;
+    size_t entries = 0;
+
+    MemoCache(){ setCapacity(DEFAULT_CAPACITY); }
+    // Redondea a potencia de 2 (al menos WAYS) y vacía la tabla.
+    void setCapacity(size_t n){
+        size_t c = WAYS; while(c < n) c <<= 1;
+        table.assign(c, Entry{}); entries = 0;
+    }
+    void clear(){ fill(table.begin(), table.end(), Entry{}); entries = 0; hits = misses = evictions = 0; }
+    size_t capacity() const { return table.size(); }
+    const double* find(uint32_t fn, const uint64_t* args, size_t n, size_t h);
+    void insert(uint32_t fn, const uint64_t* args, size_t n, size_t h, double result);
+};
+
+// La caché del hilo actual.
+inline MemoCache& memoCache(){ thread_local MemoCache c; return c; }
+
+// Ejecuta el Memo 'in' con sus argumentos en la cima de la pila (sp) y devuelve
+// la nueva cima, con el resultado.
+double* memoCall(const Instr& in, double* sp, const double* vars);
+
+// Cambia por Memo las llamadas de p que se pueden memorizar.
+void memoizeCalls(Program& p);
+
+// El programa sin CallU ni Memo: el propio p o su versión expandida.
+inline const Program& flatProgram(const Program& p){
+    if(!p.calls) return p;
+    if(!p.flat) throw CalcError(ErrCode::Unsupported, "Las llamadas a funciones anidadas son demasiado grandes para expandirlas");
+    return *p.flat;
+}
+
+// x^n con n entero por cuadrados sucesivos: el mismo orden de productos que mapPowI.
+static const int POWI_MAX = 32;
+inline double powi(double x, int n){
+    unsigned m = n<0 ? 0u-(unsigned)n : (unsigned)n;
+    double r = 1.0;
+    for(bool first = true; m; m >>= 1, x *= x)
+        if(m & 1){ r = first ? x : r*x; first = false; }
+    return n<0 ? 1.0/r : r;
+}
+
+// Optimización sobre el bytecode recién compilado: pliega las subexpresiones
+// constantes (literales y variables de Env::consts) calculándolas con las mismas
+// funciones que el intérprete, y aplica identidades que son exactas en IEEE 754
+// para todo x, incluidos NaN, ±inf y -0:
+//   x*1, 1*x, x/1, x^1, x-0, x+(-0), (-0)+x, -(-x)  ->  x
+// x+0 no se simplifica porque (-0)+0 es +0. Una división entre un cero constante
+// no se pliega: el error sigue apareciendo al evaluar.
+// Reducción de fuerza de x^k y pow(x,k) con k constante:
+//   k == 0  -> 1 (si x no puede lanzar un error)   exacta
+//   k == 2  -> x*x (Sqr)                           solo con env.fastMath (x*x redondea bien y
+//                                                   pow de glibc no siempre: ~1 de cada 1000 en 1 ULP)
+//   k entero, |k| <= POWI_MAX -> productos (PowI)   solo con env.fastMath
+//   k == 0.5 -> sqrt(x)                            solo con env.fastMath (difiere en -0, -inf
+//                                                   y en ~1 de cada 2000 entradas en 1 ULP)
+void foldProgram(Program& p, const Env& env);
+
+// Compila la RPN validando la pila (los errores de aridad aparecen aquí y no al evaluar).
+// Con allowFree, las variables sin valor en env quedan libres (ranura sin definir)
+// para enlazarlas después a columnas; runProgram no admite programas con variables libres.
+// Interna en env el destino de la asignación y las variables libres.
+// Con params (el cuerpo de una función), esos nombres se compilan como Arg i.
+Program compileRPN(const vector<Node>& rpn, Env& env, bool allowFree=false, const vector<string>* params=nullptr);
+
+// Intérprete: bucle con goto calculado en GCC/Clang y switch en el resto.
+#if defined(__GNUC__) || defined(__clang__)
+#define SC_COMPUTED_GOTO 1
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#else
+#define SC_COMPUTED_GOTO 0
+#endif
+
+// 'args': los argumentos, si p es el cuerpo de una función.
+inline double runProgram(const Program& p, const double* vars, const double* args = nullptr){
+    double small[64]; vector<double> big;
+    double* st = small;
+    if(p.maxDepth > 64){ big.resize(p.maxDepth); st = big.data(); }
+    double* sp = st - 1; // cima de la pila
+    const Instr* ip = p.code.data();
+
+#if SC_COMPUTED_GOTO
+    static const void* const labels[] = { &&L_Num, &&L_Var, &&L_Neg, &&L_Add, &&L_Sub, &&L_Mul, &&L_Div, &&L_Pow, &&L_Sqr, &&L_PowI, &&L_Call1, &&L_Call2, &&L_Arg, &&L_CallU, &&L_Memo, &&L_Ret };
+#define VM_CASE(x) L_##x:
+#define VM_NEXT() do{ ++ip; goto *labels[(size_t)ip->op]; }while(0)
+    goto *labels[(size_t)ip->op];
+#else
+#define VM_CASE(x) case Op::x:
+#define VM_NEXT() do{ ++ip; goto dispatch; }while(0)
+dispatch:
+    switch(ip->op){
+#endif
+    VM_CASE(Num)   *++sp = ip->num; VM_NEXT();
+    VM_CASE(Var)   *++sp = vars[ip->arg]; VM_NEXT();
+    VM_CASE(Neg)   *sp = -*sp; VM_NEXT();
+    VM_CASE(Add)   sp[-1] = sp[-1] + sp[0]; --sp; VM_NEXT();
+    VM_CASE(Sub)   sp[-1] = sp[-1] - sp[0]; --sp; VM_NEXT();
+    VM_CASE(Mul)   sp[-1] = sp[-1] * sp[0]; --sp; VM_NEXT();
+    VM_CASE(Div)
+        if(sp[0]==0.0) throw CalcError(ErrCode::DivisionByZero, "División por cero");
+        sp[-1] = sp[-1] / sp[0]; --sp; VM_NEXT();
+    VM_CASE(Pow)   sp[-1] = pow(sp[-1], sp[0]); --sp; VM_NEXT();
+    VM_CASE(Sqr)   *sp = *sp * *sp; VM_NEXT();
+    VM_CASE(PowI)  *sp = powi(*sp, (int32_t)ip->arg); VM_NEXT();
+    VM_CASE(Call1) *sp = ip->f1(*sp); VM_NEXT();
+    VM_CASE(Call2) sp[-1] = ip->f2(sp[-1], sp[0]); --sp; VM_NEXT();
+    VM_CASE(Arg)   *++sp = args[ip->arg]; VM_NEXT();
+    VM_CASE(CallU) { // los argumentos son las nargs entradas de la cima
+        uint32_t n = ip->uf->nargs;
+        double r = runProgram(ip->uf->body, vars, sp+1-n);
+        sp -= n; *++sp = r;
+    } VM_NEXT();
+    VM_CASE(Memo)  sp = memoCall(*ip, sp, vars); VM_NEXT();
+    VM_CASE(Ret)   return *sp;
+#if !SC_COMPUTED_GOTO
+    }
+    return *sp;
+#endif
+#undef VM_CASE
+#undef VM_NEXT
+}
+
+#if SC_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+// Ejecuta el programa y, si es una asignación, guarda el resultado en el entorno.
+// Tras asignar un valor a 'slot': si era una definición reactiva deja de serlo
+// y se recalculan, en orden topológico, las fórmulas que dependen de ella.
+void onAssigned(Env& env, uint32_t slot);
+
+inline double evalProgram(const Program& p, Env& env){
+    double v = runProgram(p, env.vals.data());
+    if(!p.target.empty()){
+        env.vals[p.targetSlot] = v; env.defined[p.targetSlot] = 1;
+        if(!env.vectors.empty()) env.vectors.erase(p.targetSlot);
+        if(!env.formulas.empty()) onAssigned(env, p.targetSlot);
+    }
+    return v;
+}
+
+// --- Definición de funciones de usuario (ver UserFunc) ---
+struct ExprCache;
+
+// Cabecera `nombre(p1, p2...) =` de una definición de función: si la línea
+// empieza así, rellena name y params y devuelve la posición del cuerpo; si no, 0.
+size_t parseFuncHead(string_view line, string_view& name, vector<string_view>& params);
+
+// Define (o redefine) una función de usuario. Lanza CalcError si el nombre es
+// de una función integrada, los parámetros se repiten o el cuerpo no compila.
+void defineFunction(Env& env, string_view name, const vector<string_view>& params, string_view body);
+
+// Línea `f(x, y) = expresión`: false si no lo es; si lo es, añade a 'out'
+// "[ok] f(x, y) = expresión" (sin '\n'; con batch, nada) o lanza CalcError.
+// Vacía la caché: las líneas ya compiladas tienen enlazada la definición anterior.
+bool functionLine(string_view line, Env& env, ExprCache& cache, string& out, bool batch = false);
+
+// --- Definiciones reactivas ---
+// `y := 3*x^2 + 1` guarda el programa junto con sus dependencias. Al cambiar una
+// entrada solo se recalculan las fórmulas alcanzables desde ella, por niveles en
+// orden topológico; con env.recalcPool, los niveles anchos se reparten entre
+// hilos (las fórmulas de un mismo nivel no dependen unas de otras). Una fórmula
+// que falla queda en NaN (y con ella las que dependen de ella) y su error va a
+// env.recalcErrors. Los ciclos se rechazan al definir.
+// Define (o redefine) 'name'; devuelve su valor. Lanza CalcError si la
+// expresión no compila, es una asignación o crea un ciclo.
+double defineFormula(Env& env, const string& name, string_view src);
+
+// Línea `nombre := expresión`: false si no lo es; si lo es, añade a 'out'
+// "[ok] nombre := valor" (sin '\n'; con batch, solo el valor, como una
+// asignación) o lanza CalcError. Vacía la caché si redefine pi o e.
+bool defineLine(string_view line, Env& env, ExprCache& cache, string& out, bool batch = false);
+
+// --- Derivación automática en modo directo ---
+// Evalúa el programa con números duales: cada valor de la pila lleva, además,
+// sus derivadas respecto de k variables semilla, así que una sola pasada da el
+// valor y las k parciales (sin el error ni las 2k+1 evaluaciones de las
+// diferencias finitas). Donde la función no es derivable (abs en 0, floor...)
+// se toma la derivada lateral 0; fuera del dominio sale NaN, como en el valor.
+// d[j] = ∂p/∂vars[seeds[j]]. Las variables del programa deben tener valor.
+double runProgramDual(const Program& p, const double* vars, const uint32_t* seeds, size_t k, double* d);
+
+// Derivada de una función integrada de una variable en x.
+double derivF1(F1 id, double x);
+
+// Línea `diff(expr, x[, y...])`: devuelve false si no lo es; si lo es, añade a
+// 'out' "valor, d/dx = ..., d/dy = ..." (sin '\n') o lanza CalcError.
+bool diffLine(string_view line, Env& env, string& out);
+
+// --- Derivación automática en modo inverso ---
+// Para gradientes respecto de muchas variables: la pasada hacia delante guarda
+// en la cinta el valor de cada instrucción y una sola pasada hacia atrás reparte
+// las adjuntas hasta las variables, así que el coste no depende de cuántas haya.
+// bind() prepara la estructura de la cinta una vez por programa (qué instrucción
+// produce cada operando y qué subexpresiones dependen de variables); después
+// forward()/backward() no reservan memoria.
+struct GradTape {
+    vector<uint32_t> a, b;   // instrucción que produce el primer/segundo operando
+    vector<char> active;     // la subexpresión lee alguna variable
+    vector<double> val, adj; // valor y adjunta de cada instrucción
+    vector<uint32_t> slots;  // ranuras que lee el programa, sin repetir
+
+    void bind(const Program& p);
+    double forward(const Program& p, const double* vars);
+    // Suma ∂p/∂vars[s] a grad[s] para cada ranura s de 'slots' (las demás no se tocan).
+    void backward(const Program& p, double* grad);
+};
+
+// Línea `grad(expr)`: valor y gradiente respecto de todas las variables de la
+// expresión, en el formato de diffLine. false si la línea no es grad(...).
+bool gradLine(string_view line, Env& env, string& out);
+
+// --- Evaluación por columnas ---
+// Un programa compilado una vez se aplica a columnas contiguas bloque a bloque:
+// cada instrucción recorre un bloque entero, así que el coste de interpretar se
+// paga por bloque y no por fila. Las entradas de la pila son escalares
+// (literales, variables de Env) o punteros a un bloque de datos.
+struct ColumnBinding { string name; const double* data; };
+
+static const size_t BATCH_BLOCK = 2048;
+
+// Las funciones con núcleo vectorial van a simdKernels(); asin/acos/atan, a libm.
+void mapF1(F1 id, const double* a, double* o, size_t n);
+
+// Operador binario sobre bloques; a lo sumo uno de los operandos es escalar (puntero nulo).
+void mapBinary(Op op, const double* a, double sa, const double* b, double sb, double* o, size_t n, size_t row0);
+
+// a^k por bloques con los mismos productos que powi(); 'base' es un bloque auxiliar.
+void mapPowI(const double* a, int k, double* o, double* base, size_t n);
+
+// Evalúa p sobre 'rows' filas; cada variable del programa se toma de la columna
+// homónima o, si no hay columna, del valor escalar de Env. 'out' no debe solapar
+// con las columnas de entrada.
+// Filas [r0, r1) con las columnas ya resueltas por ranura (colOf). La pila y
+// los bloques intermedios son de cada hilo y se reutilizan entre llamadas.
+// rowBase se suma a la fila que citan los errores (para datos que no empiezan en la fila 0).
+void evalColumnRange(const Program& p, const Env& env, const vector<const double*>& colOf, size_t r0, size_t r1, double* out,
+                     size_t rowBase = 0);
+
+// Con pool, los bloques se reparten en tareas de 'grain' bloques entre sus hilos;
+// los errores (división por cero) informan la misma fila que en secuencial.
+void evalColumns(const Program& p, const Env& env, const vector<ColumnBinding>& cols, size_t rows, double* out,
+                 WorkPool* pool = nullptr, size_t grain = 16);
+
+// Como evalColumns, pero con el gradiente de cada fila (modo inverso):
+// grad[j][r] = ∂p/∂wrt[j] en la fila r, con wrt ranuras de env.
+void gradColumns(const Program& p, const Env& env, const vector<ColumnBinding>& cols, size_t rows,
+                 const uint32_t* wrt, size_t k, double* out, double* const* grad,
+                 WorkPool* pool = nullptr, size_t grain = 16);
+
+// --- Barridos: sweep(expr, x, inicio, fin, paso[, reducción]) ---
+// x recorre inicio, inicio+paso, ... hasta fin (incluido si cae en la rejilla)
+// sin guardar la entrada: cada tarea genera sus bloques de BATCH_BLOCK valores
+// (x_i = inicio + i·paso, sin acumular error) y los evalúa por columnas. Los
+// resultados se escriben como líneas en el formato de env o se reducen. Cada
+// bloque se reduce por su cuenta (la suma, por parejas) y los parciales se
+// combinan en orden de bloque (la suma, compensada), así que el resultado es el
+// mismo bit a bit con cualquier número de hilos.
+enum class Reduce : uint8_t { None, Sum, Prod, Min, Max, Mean }; // Min y Max propagan NaN, como Sum
+
+inline bool parseReduce(string_view s, Reduce& r){
+    if(s=="sum"){ r = Reduce::Sum; return true; }
+    if(s=="prod"){ r = Reduce::Prod; return true; }
+    if(s=="min"){ r = Reduce::Min; return true; }
+    if(s=="max"){ r = Reduce::Max; return true; }
+    if(s=="mean"){ r = Reduce::Mean; return true; }
+    return false;
+}
+
+struct Sweep { Program prog; uint32_t slot; double start, step; size_t count; Reduce reduce; };
+
+// Compila la expresión y evalúa los límites (expresiones constantes). 'reduce'
+// vacío: sin reducción. Lanza CalcError si el paso es 0, no avanza hacia el fin
+// o la rejilla no es finita.
+Sweep parseSweep(Env& env, string_view expr, string_view var, string_view start, string_view stop, string_view step,
+                 string_view reduce);
+
+// Ejecuta el barrido. Sin reducción, entrega el texto a emit, en orden, por
+// trozos de líneas terminadas en '\n', y devuelve NaN; si no, devuelve la reducción.
+// Con pool, las tareas de 'grain' bloques se reparten por rondas acotadas, así que
+// la memoria no crece con el número de puntos.
+double runSweep(const Sweep& s, const Env& env, const function<void(string_view)>& emit,
+                WorkPool* pool = nullptr, size_t grain = 16);
+
+// Línea `sweep(...)`: false si no lo es. Si lo es, la reducción se añade a 'out';
+// los resultados sin reducir se entregan a 'emit' según se calculan (como en
+// runSweep, cada uno con su '\n', y 'out' no cambia) o, sin emit, se añaden a
+// 'out' uno por línea (sin el último '\n'), hasta SWEEP_BUFFER_MAX puntos.
+static const size_t SWEEP_BUFFER_MAX = size_t(1)<<20;
+bool sweepLine(string_view line, Env& env, string& out, WorkPool* pool = nullptr,
+               const function<void(string_view)>& emit = nullptr);
+
+// --- Reducciones sobre un intervalo entero: sum(expr, i, a, b) ---
+// También prod, min y max: i recorre a, a+1, ..., b (a y b expresiones
+// constantes con valor entero) y se reduce como en un barrido de paso 1. Un
+// intervalo vacío (b < a) da el neutro: 0, 1, inf o -inf.
+Sweep parseRange(Env& env, Reduce reduce, string_view expr, string_view var, string_view a, string_view b);
+
+// Línea `sum(...)`, `prod(...)`, `min(...)` o `max(...)` con cuatro argumentos:
+// false si no lo es; si lo es, añade a 'out' el resultado. Solo como línea
+// completa: dentro de una expresión, el compilador lo rechaza con un error que
+// lo dice. Con otra aridad, los nombres pueden ser funciones de usuario.
+bool reduceLine(string_view line, Env& env, string& out, WorkPool* pool = nullptr);
+
+// --- Vectores (ver Vector) ---
+// Una expresión que lee alguna variable vectorial se evalúa elemento a elemento
+// con la evaluación por columnas: los escalares se difunden a todos los
+// elementos, y todos los vectores que lee deben tener la misma longitud.
+
+// true si p lee alguna variable vectorial.
+bool readsVector(const Program& p, const Env& env);
+
+// Lanza CalcError si p lee vectores ('who': lo que no los admite, para el mensaje).
+void requireScalar(const Program& p, const Env& env, const char* who);
+
+// Guarda v en la ranura: la variable deja de ser escalar (y reactiva). Falla si
+// la leen definiciones reactivas, que solo trabajan con escalares.
+void assignVector(Env& env, uint32_t slot, shared_ptr<const Vector> v);
+
+// Evalúa p por elementos (con pool, por bloques en paralelo); si es una
+// asignación, guarda el resultado. `w = v` comparte el bloque de v.
+shared_ptr<const Vector> evalVector(const Program& p, Env& env, WorkPool* pool = nullptr);
+
+// "[1.0000000000, 2.0000000000, ...]"; los vectores largos se resumen.
+void appendVector(string& out, const Vector& v, NumFormat f, int precision);
+
+// Si p lee vectores, lo evalúa con evalVector y añade el resultado a 'out'; si
+// no, devuelve false sin evaluar.
+bool vectorProgram(const Program& p, Env& env, string& out, WorkPool* pool = nullptr);
+
+// Línea `[e1, e2, ...]`, `v = [e1, e2, ...]` (elementos escalares) o
+// `v = load(ruta)` (números separados por espacios, comas o saltos de línea):
+// false si no es ninguna; si lo es, añade el vector a 'out'.
+bool vectorLine(string_view line, Env& env, ExprCache& cache, string& out);
+
+// --- Caché LRU de expresiones compiladas ---
+// Clave: la línea ya recortada. Guarda el programa compilado para que las líneas
+// repetidas no vuelvan a pasar por toRPN/compileRPN. El tamaño
+// se limita por un presupuesto aproximado en bytes (0 = desactivada).
+// Los programas guardan ranuras de Env y llevan pi/e plegadas: hay que vaciarla
+// cuando se borran las variables (:clear) o se reasigna una constante.
+struct ExprCache {
+    struct Entry { string key; Program prog; size_t bytes; };
+    list<Entry> lru; // frente = uso más reciente
+    unordered_map<string_view, list<Entry>::iterator> index;
+    size_t budget = size_t(4)<<20, used = 0;
+    uint64_t hits = 0, misses = 0, evictions = 0;
+
+    static size_t footprint(const string& key, const Program& p){
+        return sizeof(Entry) + 4*sizeof(void*) + key.capacity() + p.code.capacity()*sizeof(Instr) + p.target.capacity() + p.reads.capacity()*sizeof(uint32_t)
+             + (p.flat ? p.flat->code.capacity()*sizeof(Instr) : 0);
+    }
+
+    const Program* find(string_view key){
+        auto it = index.find(key);
+        if(it==index.end()){ ++misses; return nullptr; }
+        ++hits;
+        lru.splice(lru.begin(), lru, it->second);
+        return &it->second->prog;
+    }
+
+    // Inserta moviendo 'prog' solo si cabe en el presupuesto; si no, lo deja intacto y devuelve nullptr.
+    const Program* put(const string& key, Program& prog){
+        size_t bytes = footprint(key, prog);
+        if(bytes > budget) return nullptr;
+        lru.push_front({key, move(prog), bytes});
+        index[lru.front().key] = lru.begin();
+        used += bytes;
+        shrinkTo(budget);
+        return &lru.front().prog;
+    }
+
+    void shrinkTo(size_t limit){
+        while(used > limit && !lru.empty()){
+            used -= lru.back().bytes;
+            index.erase(lru.back().key);
+            lru.pop_back(); ++evictions;
+        }
+    }
+    void setBudget(size_t b){ budget = b; shrinkTo(budget); }
+    void clear(){ index.clear(); lru.clear(); used = 0; }
+};
+
+// --- Evaluación de una línea (modo batch y benchmarks) ---
+// Evalúa una línea ya recortada y añade su línea de salida (con '\n') a 'out'.
+void batchLine(string_view line, Env& env, ExprCache& cache, string& out);
+
+} // namespace supercalc::detail
@@ -2,316 +2,476 @@
 #include <iomanip>
 #include <string>
 #include <vector>
-#include <unordered_map>
-#include <functional>
 #include <algorithm>
-#include <cctype>
-#include <cmath>
 #include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include "engine.hpp"
+#include "stats.hpp"
 
 using namespace std;
+using namespace supercalc::detail;
 
-// --- Utilidades de string ---
-static inline string ltrim(string s){ s.erase(s.begin(), find_if(s.begin(), s.end(), [](unsigned char c){return !isspace(c);})); return s; }
-static inline string rtrim(string s){ s.erase(find_if(s.rbegin(), s.rend(), [](unsigned char c){return !isspace(c);} ).base(), s.end()); return s; }
-static inline string trim(string s){ return ltrim(rtrim(s)); }
-
-// --- Tokenización ---
-enum class TokType { Number, Ident, LParen, RParen, Comma, Plus, Minus, Star, Slash, Caret, Assign, End };
-struct Token{ TokType t; double value{}; string text; };
-
-struct Lexer {
-    const string s; size_t i=0, n;
-    Lexer(string src): s(move(src)), n(s.size()) {}
-
-    static bool isIdentStart(char c){ return isalpha((unsigned char)c) || c=='_'; }
-    static bool isIdentChar(char c){ return isalnum((unsigned char)c) || c=='_'; }
+// Opciones globales de línea de comandos para los modos no interactivos.
+struct RunOptions {
+    bool fastMath = false;
+    bool memo = false;     // --memo: memoriza las llamadas a funciones puras
+    NumFormat format = NumFormat::Fixed; // --format fixed|sci|shortest
+    unsigned threads = 1;  // --threads N; 1 = secuencial
+    bool pin = false;      // --pin: fija cada hilo a una CPU
+    size_t grain = 16;     // --grain N: bloques de BATCH_BLOCK filas por tarea en --table
+};
 
-    Token next(){
-        while(i<n && isspace((unsigned char)s[i])) ++i;
-        if(i>=n) return {TokType::End,0,""};
-        char c = s[i];
-        // números (incluye . y notación científica)
-        if (isdigit((unsigned char)c) || c=='.'){
-            size_t start=i; bool seenDot = (c=='.');
-            ++i;
-            while(i<n && (isdigit((unsigned char)s[i]) || (!seenDot && s[i]=='.'))){ if(s[i]=='.') seenDot=true; ++i; }
-            // notación científica
-            if(i<n && (s[i]=='e' || s[i]=='E')){
-                size_t j=i+1; if(j<n && (s[j]=='+' || s[j]=='-')) ++j; bool any=false;
-                while(j<n && isdigit((unsigned char)s[j])){ any=true; ++j; }
-                if(any) i=j; // consume si es válido
-            }
-            double val = strtod(s.substr(start, i-start).c_str(), nullptr);
-            return {TokType::Number, val, ""};
+// --- Modo --table: una expresión sobre una tabla completa ---
+// Entrada: cabecera con los nombres de columna y filas numéricas, separadas por
+// comas o espacios. Salida: un resultado por fila.
+static int runTable(const string& expr, istream& in, const RunOptions& opt){
+    auto split = [](const string& l){
+        vector<string> f; string cur;
+        for(char c: l){
+            if(c==',' || isspace((unsigned char)c)){ if(!cur.empty()){ f.push_back(cur); cur.clear(); } }
+            else cur.push_back(c);
         }
-        if (isIdentStart(c)){
-            size_t start=i++; while(i<n && isIdentChar(s[i])) ++i;
-            return {TokType::Ident, 0.0, s.substr(start, i-start)};
-        }
-        ++i; // un solo char
-        switch(c){
-            case '(': return {TokType::LParen,0,"("};
-            case ')': return {TokType::RParen,0,")"};
-            case ',': return {TokType::Comma,0,","};
-            case '+': return {TokType::Plus,0,"+"};
-            case '-': return {TokType::Minus,0,"-"};
-            case '*': return {TokType::Star,0,"*"};
-            case '/': return {TokType::Slash,0,"/"};
-            case '^': return {TokType::Caret,0,"^"};
-            case '=': return {TokType::Assign,0,"="};
-            default: throw runtime_error(string("Símbolo inválido: ")+c);
+        if(!cur.empty()) f.push_back(cur);
+        return f;
+    };
+
+    Env env; string line; vector<string> names;
+    while(names.empty() && getline(in,line)) names = split(line);
+    if(names.empty()){ cerr << "[error] tabla vacía\n"; return 1; }
+    vector<vector<double>> cols(names.size());
+    size_t rows = 0;
+    while(getline(in,line)){
+        auto f = split(line);
+        if(f.empty()) continue;
+        if(f.size()!=names.size()){ cerr << "[error] fila " << rows+1 << ": se esperaban " << names.size() << " valores\n"; return 1; }
+        for(size_t c=0;c<f.size();++c){
+            char* end=nullptr; double v = strtod(f[c].c_str(), &end);
+            if(*end){ cerr << "[error] fila " << rows+1 << ": número inválido '" << f[c] << "'\n"; return 1; }
+            cols[c].push_back(v);
         }
+        ++rows;
     }
-};
-
-// --- Shunting-yard a RPN ---
-struct OpInfo { int prec; bool rightAssoc; int arity; };
-
-static const unordered_map<string, OpInfo> OP = {
-    {"+", {1,false,2}}, {"-", {1,false,2}}, {"*", {2,false,2}}, {"/", {2,false,2}}, {"^", {3,true,2}},
-    {"u-", {4,true,1}} // menos unario
-};
-
-struct Node { // token para la RPN
-    enum Kind{KNum, KVar, KOp, KFunc, KArgSep, KAssign} k;
-    double val{}; string text; int argc{};
-};
 
-static bool isOpTok(TokType t){ return t==TokType::Plus||t==TokType::Minus||t==TokType::Star||t==TokType::Slash||t==TokType::Caret; }
-
-vector<Node> toRPN(const string& line){
-    Lexer L(line); vector<Node> output; vector<Node> ops;
-    Token prev{TokType::End};
-    for(Token tok = L.next(); tok.t!=TokType::End; tok=L.next()){
-        if(tok.t==TokType::Number){ output.push_back({Node::KNum, tok.value}); }
-        else if(tok.t==TokType::Ident){ output.push_back({Node::KVar, 0, tok.text}); }
-        else if(tok.t==TokType::Comma){ // separador de argumentos
-            while(!ops.empty() && ops.back().k!=Node::KArgSep && !(ops.back().k==Node::KOp && ops.back().text=="(") ){
-                output.push_back(ops.back()); ops.pop_back();
-            }
-            if(ops.empty()) throw runtime_error("Coma fuera de contexto");
-            output.push_back({Node::KArgSep});
-        }
-        else if(tok.t==TokType::LParen){ ops.push_back({Node::KOp,0,"("}); }
-        else if(tok.t==TokType::RParen){
-            while(!ops.empty() && !(ops.back().k==Node::KOp && ops.back().text=="(")){
-                output.push_back(ops.back()); ops.pop_back();
-            }
-            if(ops.empty()) throw runtime_error("Paréntesis desbalanceados");
-            ops.pop_back(); // quita '('
-            if(!ops.empty() && ops.back().k==Node::KFunc){ output.push_back(ops.back()); ops.pop_back(); }
-        }
-        else if(tok.t==TokType::Assign){ ops.push_back({Node::KAssign}); }
-        else if(isOpTok(tok.t)){
-            string sym = (tok.t==TokType::Plus?"+": tok.t==TokType::Minus?"-": tok.t==TokType::Star?"*": tok.t==TokType::Slash?"/":"^");
-            bool unary = (prev.t==TokType::End || prev.t==TokType::LParen || prev.t==TokType::Comma || isOpTok(prev.t) || prev.t==TokType::Assign);
-            if(unary && sym=="-") sym = "u-";
-            auto oi = OP.at(sym);
-            while(!ops.empty() && (ops.back().k==Node::KOp||ops.back().k==Node::KFunc)){
-                OpInfo top; bool isTopOp=false;
-                if(ops.back().k==Node::KOp && OP.count(ops.back().text)){ top=OP.at(ops.back().text); isTopOp=true; }
-                if(isTopOp && ( (oi.rightAssoc? oi.prec<top.prec : oi.prec<=top.prec) )){ output.push_back(ops.back()); ops.pop_back(); }
-                else break;
-            }
-            ops.push_back({Node::KOp,0,sym});
-        }
-        else{
-            throw runtime_error("Token inesperado");
+    for(auto& n: names) env.consts.erase(n); // una columna llamada pi no es la constante
+    env.fastMath = opt.fastMath; env.format = opt.format;
+    try{
+        Program p = compileRPN(toRPN(trim(expr)), env, true);
+        vector<ColumnBinding> bind;
+        for(size_t c=0;c<names.size();++c) bind.push_back({names[c], cols[c].data()});
+        vector<double> out(rows);
+        unique_ptr<WorkPool> pool;
+        if(opt.threads>1) pool.reset(new WorkPool(opt.threads, opt.pin));
+        evalColumns(p, env, bind, rows, out.data(), pool.get(), opt.grain);
+        string buf; buf.reserve(size_t(1)<<16);
+        for(double v: out){
+            appendNumber(buf, v, env.format, env.precision); buf.push_back('\n');
+            if(buf.size() >= (size_t(1)<<16)){ cout.write(buf.data(), (streamsize)buf.size()); buf.clear(); }
         }
-        prev = tok;
+        cout.write(buf.data(), (streamsize)buf.size());
+    }catch(const exception& ex){
+        cerr << "[error] " << ex.what() << "\n"; return 1;
     }
+    return 0;
+}
 
-    while(!ops.empty()){
-        if(ops.back().k==Node::KOp && ops.back().text=="(") throw runtime_error("Paréntesis desbalanceados");
-        output.push_back(ops.back()); ops.pop_back();
+// --- Modo --sweep: una expresión sobre una rejilla que no se guarda ---
+// Los resultados se escriben por trozos a medida que se evalúan (o solo la reducción).
+static int runSweepMode(char** args, int n, const RunOptions& opt){
+    Env env; env.fastMath = opt.fastMath; env.memo = opt.memo; env.format = opt.format;
+    try{
+        Sweep s = parseSweep(env, args[0], args[1], args[2], args[3], args[4], n==6 ? args[5] : "");
+        unique_ptr<WorkPool> pool;
+        if(opt.threads>1) pool.reset(new WorkPool(opt.threads, opt.pin));
+        double r = runSweep(s, env, [](string_view t){ fwrite(t.data(), 1, t.size(), stdout); }, pool.get(), opt.grain);
+        if(s.reduce!=Reduce::None){
+            string out; appendNumber(out, r, env.format, env.precision); out.push_back('\n');
+            fwrite(out.data(), 1, out.size(), stdout);
+        }
+    }catch(const exception& ex){
+        fflush(stdout);
+        cerr << "[error] " << ex.what() << "\n"; return 1;
     }
-    return output;
+    return 0;
 }
 
-// --- Evaluador RPN con soporte de funciones/variables ---
-struct Env{
-    unordered_map<string,double> vars;
-    int precision = 10;
-    Env(){ vars["pi"]=acos(-1.0); vars["e"]=exp(1.0); }
-};
+// --- Modo --batch: una expresión por línea, sin prompt ni banner ---
+// La entrada se lee con fread en bloques de 1 MiB y la salida se acumula en
+// búferes propios que se vuelcan con fwrite. Cada línea de entrada produce una
+// de salida (el valor, una línea vacía o "[error] ..."), así que un error no
+// corta el flujo y la salida queda alineada con la entrada. Las definiciones
+// := que fallan al recalcularse se avisan por stderr, con su línea de entrada.
 
-using UFunc = function<double(double)>;
-using BFunc = function<double(double,double)>;
+// Recorre 'in' en bloques grandes y llama a onLine con cada línea (sin '\n').
+template<class F> static bool forEachLine(FILE* in, F onLine){
+    vector<char> buf(size_t(1)<<20); string carry; // carry: línea partida entre dos bloques
+    size_t n;
+    while((n = fread(buf.data(), 1, buf.size(), in)) > 0){
+        const char* p = buf.data(); const char* end = p+n;
+        while(const char* nl = (const char*)memchr(p, '\n', (size_t)(end-p))){
+            if(carry.empty()) onLine(string_view(p, (size_t)(nl-p)));
+            else { carry.append(p, nl); onLine(string_view(carry)); carry.clear(); }
+            p = nl+1;
+        }
+        carry.append(p, end);
+    }
+    if(!carry.empty()) onLine(string_view(carry));
+    return !ferror(in);
+}
 
-static const unordered_map<string,UFunc> UF = {
-    {"sin", (UFunc)[](double a){return sin(a);} }, {"cos", (UFunc)[](double a){return cos(a);} }, {"tan", (UFunc)[](double a){return tan(a);} },
-    {"asin", (UFunc)[](double a){return asin(a);} }, {"acos", (UFunc)[](double a){return acos(a);} }, {"atan", (UFunc)[](double a){return atan(a);} },
-    {"sqrt", (UFunc)[](double a){return sqrt(a);} }, {"cbrt", (UFunc)[](double a){return cbrt(a);} }, {"exp", (UFunc)[](double a){return exp(a);} },
-    {"abs", (UFunc)[](double a){return fabs(a);} }, {"floor", (UFunc)[](double a){return floor(a);} }, {"ceil", (UFunc)[](double a){return ceil(a);} }, {"round", (UFunc)[](double a){return round(a);} },
-    {"ln", (UFunc)[](double a){return log(a);} }, {"log", (UFunc)[](double a){return log(a);} }, {"log10", (UFunc)[](double a){return log10(a);} }
-};
+// Avisa por stderr de las fórmulas que fallaron al recalcular tras la línea 'n'.
+static void reportRecalc(Env& env, size_t n){
+    for(auto& e: env.recalcErrors) cerr << "[aviso] línea " << n << ": " << e.what() << "\n";
+    env.recalcErrors.clear();
+}
 
-static const unordered_map<string,BFunc> BF = {
-    {"pow", (BFunc)[](double a,double b){ return pow(a,b); }}
-};
+static int runBatch(FILE* in, const RunOptions& opt){
+    Env env; env.fastMath = opt.fastMath; env.memo = opt.memo; env.format = opt.format; ExprCache cache;
+    const size_t FLUSH = size_t(1)<<16;
+    string out; out.reserve(FLUSH+512);
+    size_t n = 0;
+    bool ok = forEachLine(in, [&](string_view raw){
+        batchLine(trimView(raw), env, cache, out); ++n;
+        if(!env.recalcErrors.empty()) reportRecalc(env, n);
+        if(out.size()>=FLUSH){ fwrite(out.data(), 1, out.size(), stdout); out.clear(); }
+    });
+    fwrite(out.data(), 1, out.size(), stdout);
+    if(!ok){ cerr << "[error] fallo de lectura\n"; return 1; }
+    return 0;
+}
 
-double applyOp(const string& op, const vector<double>& st){
-    if(op=="u-") return -st.back();
-    if(op=="+") return st[st.size()-2] + st.back();
-    if(op=="-") return st[st.size()-2] - st.back();
-    if(op=="*") return st[st.size()-2] * st.back();
-    if(op=="/"){
-        if(st.back()==0.0) throw runtime_error("División por cero");
-        return st[st.size()-2] / st.back();
+// Versión con varios hilos. El hilo principal lee y agrupa las líneas en
+// bloques; los trabajadores compilan y evalúan cada bloque con su propia caché,
+// y un hilo escritor vuelca los bloques en el orden de entrada.
+// Las asignaciones son barreras: las evalúa el lector, en orden, sobre el Env
+// maestro, y las demás líneas se evalúan contra una copia inmutable de Env
+// tomada tras la última asignación anterior. Como esas líneas no modifican Env,
+// la salida es idéntica byte a byte a la secuencial.
+static bool isAssignmentLine(string_view line){
+    try{
+        Lexer L(line); if(L.next().t!=TokType::Ident) return false;
+        TokType t = L.next().t;
+        if(t==TokType::LParen){ string_view name; vector<string_view> params; return parseFuncHead(line, name, params)!=0; }
+        return t==TokType::Assign || t==TokType::Define;
     }
-    if(op=="^") return pow(st[st.size()-2], st.back());
-    throw runtime_error("Operador desconocido: "+op);
+    catch(const exception&){ return false; } // error léxico: lo informará el trabajador
 }
 
-// Evaluación con soporte de asignación simple: IDENT = expr
-double evalRPN(const vector<Node>& rpn, Env& env){
-    bool hasAssign=false; for(auto& n: rpn) if(n.k==Node::KAssign){ hasAssign=true; break; }
+struct BatchChunk {
+    struct Item { uint32_t off, len; int32_t snap; }; // snap < 0: la salida ya está en 'text'
+    string text; vector<Item> items;
+    vector<shared_ptr<const Env>> snaps;
+    string out; bool done = false;
+};
+
+static int runBatchParallel(FILE* in, const RunOptions& opt){
+    const unsigned threads = opt.threads;
+    const size_t CHUNK_LINES = 2048, MAX_INFLIGHT = 4*size_t(threads);
+    mutex m; condition_variable cvWork, cvDone, cvSpace;
+    deque<shared_ptr<BatchChunk>> work;     // pendientes de evaluar
+    deque<shared_ptr<BatchChunk>> inflight; // en orden de entrada hasta que se escriben
+    bool eof = false;
 
-    if(hasAssign){
-        if(rpn.size()<3 || rpn[0].k!=Node::KVar || rpn[1].k!=Node::KAssign)
-            throw runtime_error("Asignación inválida. Usa: nombre = expresión");
-        string name = rpn[0].text;
-        vector<Node> rhs(rpn.begin()+2, rpn.end());
-        vector<double> st;
-        for(size_t i=0;i<rhs.size();++i){
-            auto &n=rhs[i];
-            if(n.k==Node::KNum) st.push_back(n.val);
-            else if(n.k==Node::KVar){
-                auto itF1 = UF.find(n.text);
-                auto itF2 = BF.find(n.text);
-                if(itF1!=UF.end()){
-                    if(st.empty()) throw runtime_error("Falta argumento para función "+n.text);
-                    double a = st.back(); st.pop_back();
-                    st.push_back(itF1->second(a));
-                } else if(itF2!=BF.end()){
-                    if(st.size()<2) throw runtime_error("Faltan argumentos para función "+n.text);
-                    double b = st.back(); st.pop_back();
-                    double a = st.back(); st.pop_back();
-                    st.push_back(itF2->second(a,b));
-                } else {
-                    auto itV = env.vars.find(n.text);
-                    if(itV==env.vars.end()) throw runtime_error("Variable no definida: "+n.text);
-                    st.push_back(itV->second);
+    auto worker = [&]{
+        Env local; shared_ptr<const Env> localSnap; ExprCache cache;
+        for(;;){
+            shared_ptr<BatchChunk> c;
+            {
+                unique_lock<mutex> lk(m);
+                cvWork.wait(lk, [&]{ return !work.empty() || eof; });
+                if(work.empty()) return;
+                c = move(work.front()); work.pop_front();
+            }
+            string out; out.reserve(c->text.size()*2);
+            for(auto& it: c->items){
+                string_view line(c->text.data()+it.off, it.len);
+                if(it.snap<0){ out.append(line); continue; }
+                const shared_ptr<const Env>& s = c->snaps[(size_t)it.snap];
+                if(s!=localSnap){
+                    // las ranuras solo crecen: la caché sigue valiendo salvo que cambien las constantes plegables o las funciones
+                    if(local.consts!=s->consts || local.funcs!=s->funcs) cache.clear();
+                    local = *s; localSnap = s;
                 }
+                batchLine(line, local, cache, out);
             }
-            else if(n.k==Node::KOp){
-                int need = (n.text=="u-"?1:2);
-                if(st.size()< (size_t)need) throw runtime_error(string("Pila insuficiente (operador ")+n.text+")");
-                double res = applyOp(n.text, st);
-                for(int k=0;k<need;k++) st.pop_back();
-                st.push_back(res);
+            { lock_guard<mutex> lk(m); c->out = move(out); c->done = true; }
+            cvDone.notify_all();
+        }
+    };
+    auto writer = [&]{
+        for(;;){
+            shared_ptr<BatchChunk> c;
+            {
+                unique_lock<mutex> lk(m);
+                cvDone.wait(lk, [&]{ return (!inflight.empty() && inflight.front()->done) || (eof && inflight.empty()); });
+                if(inflight.empty()) return;
+                c = move(inflight.front()); inflight.pop_front();
             }
+            cvSpace.notify_one();
+            fwrite(c->out.data(), 1, c->out.size(), stdout);
         }
-        if(st.size()!=1) throw runtime_error("Expresión inválida en asignación");
-        env.vars[name]=st.back();
-        cout << "[ok] " << name << " = " << fixed << setprecision(env.precision) << st.back() << "\n";
-        return st.back();
-    }
+    };
+    vector<thread> pool;
+    for(unsigned t=0;t<threads;++t) pool.emplace_back(worker);
+    thread wr(writer);
 
-    vector<double> st;
-    for(const auto& n: rpn){
-        if(n.k==Node::KNum){ st.push_back(n.val); }
-        else if(n.k==Node::KVar){
-            auto itF1 = UF.find(n.text);
-            auto itF2 = BF.find(n.text);
-            if(itF1!=UF.end()){
-                if(st.empty()) throw runtime_error("Falta argumento para función "+n.text);
-                double a = st.back(); st.pop_back();
-                st.push_back(itF1->second(a));
-            } else if(itF2!=BF.end()){
-                if(st.size()<2) throw runtime_error("Faltan argumentos para función "+n.text);
-                double b = st.back(); st.pop_back();
-                double a = st.back(); st.pop_back();
-                st.push_back(itF2->second(a,b));
-            } else {
-                auto itV = env.vars.find(n.text);
-                if(itV==env.vars.end()) throw runtime_error("Variable no definida: "+n.text);
-                st.push_back(itV->second);
-            }
+    Env env; env.fastMath = opt.fastMath; env.memo = opt.memo; env.format = opt.format; ExprCache cache; // del lector: solo asignaciones
+    shared_ptr<const Env> snap; bool dirty = true;
+    auto cur = make_shared<BatchChunk>();
+    auto submit = [&]{
+        if(cur->items.empty()) return;
+        {
+            unique_lock<mutex> lk(m);
+            cvSpace.wait(lk, [&]{ return inflight.size() < MAX_INFLIGHT; });
+            inflight.push_back(cur); work.push_back(cur);
         }
-        else if(n.k==Node::KOp){
-            int need = (n.text=="u-"?1:2);
-            if(st.size()< (size_t)need) throw runtime_error(string("Pila insuficiente (operador ")+n.text+")");
-            double res = applyOp(n.text, st);
-            for(int k=0;k<need;k++) st.pop_back();
-            st.push_back(res);
+        cvWork.notify_one();
+        cur = make_shared<BatchChunk>();
+    };
+    size_t n = 0;
+    bool ok = forEachLine(in, [&](string_view raw){
+        string_view line = trimView(raw); ++n;
+        BatchChunk& c = *cur;
+        uint32_t off = (uint32_t)c.text.size();
+        bool assign = isAssignmentLine(line);
+        if(assign || line.empty() || line[0]==':'){
+            batchLine(line, env, cache, c.text);
+            if(!env.recalcErrors.empty()) reportRecalc(env, n);
+            c.items.push_back({off, (uint32_t)(c.text.size()-off), -1});
+            dirty |= assign;
+        } else {
+            if(dirty){ snap = make_shared<const Env>(env); dirty = false; }
+            if(c.snaps.empty() || c.snaps.back()!=snap) c.snaps.push_back(snap);
+            c.text.append(line);
+            c.items.push_back({off, (uint32_t)line.size(), (int32_t)c.snaps.size()-1});
         }
-    }
-    if(st.size()!=1) throw runtime_error("Expresión inválida");
-    return st.back();
+        if(c.items.size()>=CHUNK_LINES) submit();
+    });
+    submit();
+    { lock_guard<mutex> lk(m); eof = true; }
+    cvWork.notify_all(); cvDone.notify_all();
+    for(auto& t: pool) t.join();
+    wr.join();
+    if(!ok){ cerr << "[error] fallo de lectura\n"; return 1; }
+    return 0;
 }
 
-// --- Preprocesado ligero para llamadas a funciones a forma postfija ---
-string preprocessFuncCalls(const string& in){
-    string out; out.reserve(in.size()*2);
-    for(size_t i=0;i<in.size();){
-        if(isalpha((unsigned char)in[i])||in[i]=='_'){
-            size_t j=i+1; while(j<in.size() && (isalnum((unsigned char)in[j])||in[j]=='_')) ++j;
-            string name = in.substr(i, j-i);
-            size_t k=j; while(k<in.size() && isspace((unsigned char)in[k])) ++k;
-            if(k<in.size() && in[k]=='('){
-                int depth=0; size_t m=k; vector<string> args; string cur;
-                for(size_t p=k; p<in.size(); ++p){
-                    char c=in[p];
-                    if(c=='('){ depth++; if(depth>1) cur.push_back(c); }
-                    else if(c==')'){
-                        depth--; if(depth==0){ args.push_back(cur); m=p; break; } else cur.push_back(c);
-                    }
-                    else if(c==',' && depth==1){ args.push_back(cur); cur.clear(); }
-                    else { cur.push_back(c); }
-                }
-                if(depth!=0) throw runtime_error("Paréntesis desbalanceados en llamada a función");
-                out += "(";
-                for(size_t a=0;a<args.size();++a){ out += args[a]; if(a+1<args.size()) out += " "; }
-                out += ") "+name;
-                i = m+1;
-                continue;
-            }
+int main(int argc, char** argv){
+    ios::sync_with_stdio(false); cin.tie(nullptr);
+
+    RunOptions opt; opt.threads = max(1u, thread::hardware_concurrency());
+    for(;;){ // opciones globales delante del modo
+        string a = argc>=2 ? argv[1] : "";
+        if(a=="--fast-math"){ opt.fastMath = true; --argc; ++argv; }
+        else if(a=="--memo"){ opt.memo = true; --argc; ++argv; }
+        else if(a=="--pin"){ opt.pin = true; --argc; ++argv; }
+        else if(a=="--format" && argc>=3){
+            if(!parseNumFormat(argv[2], opt.format)){ cerr << "Uso: --format fixed|sci|shortest\n"; return 2; }
+            argc -= 2; argv += 2;
+        }
+        else if((a=="--threads" || a=="--grain") && argc>=3){
+            int v = atoi(argv[2]);
+            if(v<1){ cerr << "Uso: " << a << " N (N >= 1)\n"; return 2; }
+            if(a=="--threads") opt.threads = (unsigned)v; else opt.grain = (size_t)v;
+            argc -= 2; argv += 2;
         }
-        out.push_back(in[i]); ++i;
+        else break;
+    }
+    if(argc>=2 && string(argv[1])=="--batch"){
+        if(argc>3){ cerr << "Uso: SuperCalc [opciones] --batch [archivo]\n"; return 2; }
+        FILE* f = argc==3 ? fopen(argv[2], "rb") : stdin;
+        if(!f){ cerr << "[error] no se puede abrir " << argv[2] << "\n"; return 1; }
+        int rc = opt.threads>1 ? runBatchParallel(f, opt) : runBatch(f, opt);
+        if(f!=stdin) fclose(f);
+        return rc;
+    }
+    if(argc>=2 && string(argv[1])=="--sweep"){
+        if(argc<7 || argc>8){ cerr << "Uso: SuperCalc [opciones] --sweep EXPRESIÓN VARIABLE INICIO FIN PASO [sum|prod|min|max|mean]\n"; return 2; }
+        return runSweepMode(argv+2, argc-2, opt);
+    }
+    if(argc>=2 && string(argv[1])=="--table"){
+        if(argc<3 || argc>4){ cerr << "Uso: SuperCalc [opciones] --table EXPRESIÓN [archivo]\n"; return 2; }
+        if(argc==3) return runTable(argv[2], cin, opt);
+        ifstream f(argv[3]);
+        if(!f){ cerr << "[error] no se puede abrir " << argv[3] << "\n"; return 1; }
+        return runTable(argv[2], f, opt);
     }
-    return out;
-}
-
-int main(){
-    ios::sync_with_stdio(false); cin.tie(nullptr);
 
-    Env env; cout << "SuperCalc++ (C++17). Escribe :help para ayuda. Ctrl+C/Ctrl+D para salir.\n";
+    Env env; ExprCache cache; env.fastMath = opt.fastMath; env.memo = opt.memo; env.format = opt.format;
+    unique_ptr<WorkPool> pool; // recálculo de las definiciones reactivas y sweep en paralelo
+    if(opt.threads>1){ pool.reset(new WorkPool(opt.threads, opt.pin)); env.recalcPool = pool.get(); }
+    string out, vec; // línea de salida reutilizada; vec: un vector ya formateado
+    cout << "SuperCalc++ (C++17). Escribe :help para ayuda. Ctrl+C/Ctrl+D para salir.\n";
 
     string line;
     while(true){
         cout << "> ";
         if(!getline(cin,line)) break;
-        line = trim(line);
+        { SC_STAGE(Trim); line = trim(line); }
         if(line.empty()) continue;
         if(line==":quit") break;
         if(line==":help"){
-            cout << "Comandos: :help, :vars, :clear, :precision N, :quit\n"
+            cout << "Comandos: :help, :vars, :clear, :precision N, :format [fixed|sci|shortest], :cache [size N|clear], :fastmath [on|off], :memo [on|off|clear|size N], :stats [reset], :quit\n"
                  << "Funciones: sin, cos, tan, asin, acos, atan, sqrt, cbrt, log/ln, log10, exp, abs, floor, ceil, round, pow\n"
                  << "Constantes: pi, e\n"
+                 << "Derivadas: diff(expresión, x[, y...]) da el valor y las parciales; grad(expresión), el gradiente completo\n"
+                 << "Definiciones reactivas: y := 3*x^2 + 1 se recalcula al cambiar x\n"
+                 << "Funciones propias: f(x, y) = x^2 + y, luego f(2, 1)\n"
+                 << "Vectores: v = [1, 2, 3] o v = load(archivo); v*2 + sin(v) opera elemento a elemento\n"
+                 << "Barridos: sweep(3*x^2+1, x, 0, 1, 0.25[, sum|prod|min|max|mean])\n"
+                 << "Reducciones sobre enteros: sum(1/i^2, i, 1, 1000), prod(...), min(...), max(...)\n"
                  << "Ejemplos: sin(pi/2), pow(2,8), x=5, 3*x^2 + 1\n";
             continue;
         }
         if(line==":vars"){
-            for(auto &kv: env.vars){ cout << kv.first << " = " << fixed << setprecision(env.precision) << kv.second << "\n"; }
+            for(size_t i=0;i<env.vals.size();++i)
+                if(env.defined[i]){
+                    auto f = env.formulas.find((uint32_t)i);
+                    out.assign(env.names[i]);
+                    if(f!=env.formulas.end()) out.append(" := ").append(f->second.src);
+                    out.append(" = ");
+                    auto v = env.vectors.find((uint32_t)i);
+                    if(v!=env.vectors.end()) appendVector(out, *v->second, env.format, env.precision);
+                    else appendNumber(out, env.vals[i], env.format, env.precision);
+                    cout << out << "\n";
+                }
+            vector<const UserFunc*> fs;
+            for(auto& f: env.funcs) fs.push_back(f.second.get());
+            sort(fs.begin(), fs.end(), [](const UserFunc* a, const UserFunc* b){ return a->name < b->name; });
+            for(const UserFunc* f: fs){
+                out.assign(f->name).push_back('(');
+                for(size_t i=0;i<f->params.size();++i) out.append(i ? ", " : "").append(f->params[i]);
+                cout << out << ") = " << f->src << "\n";
+            }
             continue;
         }
         if(line==":clear"){
-            env.vars.clear(); env.vars["pi"]=acos(-1.0); env.vars["e"]=exp(1.0);
+            env.reset(); cache.clear();
             cout << "[ok] variables limpiadas\n"; continue;
         }
         if(line.rfind(":precision",0)==0){
             istringstream iss(line.substr(10)); int p; if(iss>>p && p>=0 && p<=30){ env.precision=p; cout<<"[ok] precisión = "<<p<<"\n"; }
-            else cout<<"Uso: :precision N (0..30)\n"; continue;
+            else cout<<"Uso: :precision N (0..30)\n";
+            continue;
+        }
+
+        if(line.rfind(":format",0)==0){
+            istringstream iss(line.substr(7)); string sub; iss>>sub;
+            if(!sub.empty() && !parseNumFormat(sub, env.format)){ cout << "Uso: :format [fixed|sci|shortest]\n"; continue; }
+            cout << "formato = " << numFormatName(env.format) << "\n";
+            continue;
+        }
+
+        if(line.rfind(":fastmath",0)==0){
+            istringstream iss(line.substr(9)); string sub; iss>>sub;
+            if(sub=="on" || sub=="off"){
+                // los programas en caché se compilaron con el modo anterior
+                if(env.fastMath != (sub=="on")){ env.fastMath = sub=="on"; cache.clear(); }
+            } else if(!sub.empty()){ cout << "Uso: :fastmath [on|off]\n"; continue; }
+            cout << "fastmath = " << (env.fastMath ? "on" : "off") << "\n";
+            continue;
+        }
+
+        if(line.rfind(":memo",0)==0){
+            istringstream iss(line.substr(5)); string sub; iss>>sub;
+            MemoCache& M = memoCache();
+            if(sub=="on" || sub=="off"){
+                // la memoización se decide al compilar
+                if(env.memo != (sub=="on")){ env.memo = sub=="on"; cache.clear(); }
+            }
+            else if(sub=="clear"){ M.clear(); cout << "[ok] memo limpiada\n"; continue; }
+            else if(sub=="size"){
+                long long n;
+                if(iss>>n && n>0){ M.setCapacity((size_t)n); cout << "[ok] capacidad de memo = " << M.capacity() << " entradas\n"; }
+                else cout << "Uso: :memo size ENTRADAS\n";
+                continue;
+            }
+            else if(!sub.empty()){ cout << "Uso: :memo [on|off|clear|size ENTRADAS]\n"; continue; }
+            cout << "memo = " << (env.memo ? "on" : "off") << " entradas=" << M.entries << "/" << M.capacity()
+                 << " aciertos=" << M.hits << " fallos=" << M.misses << " desalojos=" << M.evictions << "\n";
+            continue;
+        }
+
+        if(line.rfind(":cache",0)==0){
+            istringstream iss(line.substr(6)); string sub; iss>>sub;
+            if(sub.empty()){
+                cout << "entradas=" << cache.lru.size() << " bytes=" << cache.used << "/" << cache.budget
+                     << " aciertos=" << cache.hits << " fallos=" << cache.misses << " desalojos=" << cache.evictions << "\n";
+            } else if(sub=="clear"){ cache.clear(); cout << "[ok] caché limpiada\n"; }
+            else if(sub=="size"){
+                long long b; if(iss>>b && b>=0){ cache.setBudget((size_t)b); cout << "[ok] presupuesto de caché = " << b << " bytes\n"; }
+                else cout << "Uso: :cache size BYTES\n";
+            }
+            else cout << "Uso: :cache [size BYTES|clear]\n";
+            continue;
+        }
+
+        if(line.rfind(":stats",0)==0){
+#if SUPERCALC_STATS
+            istringstream iss(line.substr(6)); string sub; iss>>sub;
+            if(sub.empty()) stageStats().print(cout, cache.hits, cache.misses, g_allocs.load());
+            else if(sub=="reset"){ stageStats().reset(cache.hits, cache.misses, g_allocs.load()); cout << "[ok] estadísticas a cero\n"; }
+            else cout << "Uso: :stats [reset]\n";
+#else
+            cout << "estadísticas desactivadas (compila con -DSUPERCALC_STATS=ON)\n";
+#endif
+            continue;
         }
 
+        SC_STAGE(Line); SC_COUNT(lines);
         try{
-            string pre = preprocessFuncCalls(line);
-            auto rpn = toRPN(pre);
-            double ans = evalRPN(rpn, env);
-            cout << "= " << fixed << setprecision(env.precision) << ans << "\n";
+            auto flush = [&]{
+                out.push_back('\n'); cout.write(out.data(), (streamsize)out.size());
+                for(auto& e: env.recalcErrors) cout << "[aviso] " << e.what() << "\n";
+                env.recalcErrors.clear();
+            };
+            out.clear(); vec.clear();
+            if(vectorLine(line, env, cache, vec)){
+                if(line[0]=='[') out.assign("= ");
+                else out.assign("[ok] ").append(trim(line.substr(0, line.find('=')))).append(" = ");
+                out.append(vec); flush(); continue;
+            }
+            if(functionLine(line, env, cache, out) || defineLine(line, env, cache, out)){ flush(); continue; }
+            // los puntos de un barrido salen según se calculan; la reducción, por flush
+            if(sweepLine(line, env, out, pool.get(), [](string_view t){ cout.write(t.data(), (streamsize)t.size()); })){
+                if(!out.empty()) flush();
+                continue;
+            }
+            out.assign("= ");
+            if(diffLine(line, env, out) || gradLine(line, env, out) || reduceLine(line, env, out, pool.get())){ flush(); continue; }
+            Program compiled;
+            const Program* prog;
+            { SC_STAGE(Cache); prog = cache.find(line); }
+            if(!prog){
+                vector<Node> rpn;
+                { SC_STAGE(Parse); rpn = toRPN(line); }
+                { SC_STAGE(Compile); compiled = compileRPN(rpn, env); }
+                prog = cache.put(line, compiled);
+                if(!prog) prog = &compiled;
+            }
+            double ans = 0; bool isVec;
+            { SC_STAGE(Eval); isVec = vectorProgram(*prog, env, vec, pool.get()); if(!isVec) ans = evalProgram(*prog, env); }
+            {
+                SC_STAGE(Format);
+                if(!prog->target.empty()) out.assign("[ok] ").append(prog->target).append(" = ");
+                else out.assign("= ");
+                if(isVec) out.append(vec);
+                else appendNumber(out, ans, env.format, env.precision);
+                out.push_back('\n');
+                cout.write(out.data(), (streamsize)out.size());
+            }
+            for(auto& e: env.recalcErrors) cout << "[aviso] " << e.what() << "\n";
+            env.recalcErrors.clear();
+            // reasignar pi o e invalida los programas que la tenían plegada
+            if(!prog->target.empty() && env.consts.erase(prog->target)) cache.clear();
         }catch(const exception& ex){
+            SC_COUNT(errors);
             cout << "[error] " << ex.what() << "\n";
         }
     }
@@ -0,0 +1,105 @@
+#include "pool.hpp"
+#include <algorithm>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace supercalc::detail {
+
+WorkPool::WorkPool(unsigned threads, bool pin){
+    threads = std::max(1u, threads);
+    for(unsigned i=0;i<threads;++i) queues.emplace_back(new Queue);
+    for(unsigned i=1;i<threads;++i){
+        workers.emplace_back([this, i]{ run(i); });
+#if defined(__linux__)
+        if(pin){
+            unsigned ncpu = std::max(1u, std::thread::hardware_concurrency());
+            cpu_set_t set; CPU_ZERO(&set); CPU_SET(i % ncpu, &set);
+            pthread_setaffinity_np(workers.back().native_handle(), sizeof set, &set);
+        }
+#else
+        (void)pin;
+#endif
+    }
+}
+
+WorkPool::~WorkPool(){
+    { std::lock_guard<std::mutex> lk(m); stop = true; }
+    cv.notify_all();
+    for(auto& t: workers) t.join();
+}
+
+bool WorkPool::pop(unsigned self, Range& r){
+    {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lk(own.m);
+        if(!own.q.empty()){ r = own.q.back(); own.q.pop_back(); return true; }
+    }
+    for(size_t k=1;k<queues.size();++k){
+        Queue& victim = *queues[(self+k) % queues.size()];
+        std::lock_guard<std::mutex> lk(victim.m);
+        if(!victim.q.empty()){
+            r = victim.q.front(); victim.q.pop_front();
+            stolen.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Ejecuta tareas hasta que no queda ninguna pendiente en el trabajo actual.
+void WorkPool::drain(unsigned self){
+    Range r;
+    while(pending.load(std::memory_order_acquire) > 0){
+        if(!pop(self, r)){ std::this_thread::yield(); continue; }
+        try{ (*body)(r.b, r.e); }
+        catch(...){
+            std::lock_guard<std::mutex> lk(errM);
+            if(!err || r.b < errAt){ err = std::current_exception(); errAt = r.b; }
+        }
+        pending.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+void WorkPool::run(unsigned self){
+    uint64_t seen = 0;
+    for(;;){
+        {
+            std::unique_lock<std::mutex> lk(m);
+            cv.wait(lk, [&]{ return stop || epoch!=seen; });
+            if(stop) return;
+            seen = epoch;
+        }
+        drain(self);
+    }
+}
+
+void WorkPool::parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)>& fn){
+    if(n==0) return;
+    grain = std::max<size_t>(1, grain);
+    size_t tasks = (n + grain - 1) / grain;
+    if(queues.size()==1 || tasks==1){
+        for(size_t b=0; b<n; b+=grain) fn(b, std::min(n, b+grain));
+        return;
+    }
+    err = nullptr;
+    {
+        std::lock_guard<std::mutex> lk(m);
+        body = &fn;
+        pending.store(tasks, std::memory_order_relaxed);
+        // reparto inicial en bloques contiguos por cola; el robo equilibra el resto
+        size_t per = (tasks + queues.size() - 1) / queues.size();
+        for(size_t t=0; t<tasks; ++t){
+            Queue& q = *queues[t / per];
+            std::lock_guard<std::mutex> lq(q.m);
+            q.q.push_back({t*grain, std::min(n, (t+1)*grain)});
+        }
+        ++epoch;
+    }
+    cv.notify_all();
+    drain(0);
+    if(err) std::rethrow_exception(err);
+}
+
+} // namespace supercalc::detail
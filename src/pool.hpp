@@ -0,0 +1,57 @@
+// --- Grupo de hilos con robo de trabajo ---
+// Los hilos se crean una vez y se reutilizan en cada parallelFor. Cada hilo
+// tiene su propia cola de tareas: saca de su final (LIFO, datos aún en caché)
+// y, cuando se queda sin trabajo, roba del principio de la cola de otro (FIFO).
+// El hilo que llama a parallelFor también trabaja (ocupa la cola 0).
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace supercalc::detail {
+
+class WorkPool {
+public:
+    // threads: hilos en total, contando el que llama (>= 1). Con pin, cada hilo
+    // auxiliar se fija a una CPU (solo Linux; en otros sistemas no hace nada).
+    explicit WorkPool(unsigned threads, bool pin = false);
+    ~WorkPool();
+    WorkPool(const WorkPool&) = delete;
+    WorkPool& operator=(const WorkPool&) = delete;
+
+    unsigned threads() const { return (unsigned)queues.size(); }
+    uint64_t steals() const { return stolen.load(std::memory_order_relaxed); }
+
+    // Reparte [0,n) en tareas de 'grain' índices y ejecuta body(b,e) para cada
+    // una; vuelve cuando han terminado todas. Si alguna lanza, se relanza la
+    // excepción de la tarea con el índice más bajo (la misma que daría un bucle
+    // secuencial). No admite llamadas concurrentes ni anidadas.
+    void parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+private:
+    struct Range { size_t b, e; };
+    struct Queue { std::mutex m; std::deque<Range> q; };
+
+    bool pop(unsigned self, Range& r);
+    void drain(unsigned self);
+    void run(unsigned self);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex m; std::condition_variable cv; // despierta a los hilos auxiliares
+    uint64_t epoch = 0; bool stop = false;
+    const std::function<void(size_t, size_t)>* body = nullptr;
+    std::atomic<size_t> pending{0};           // tareas sin terminar
+    std::atomic<uint64_t> stolen{0};
+    std::mutex errM; std::exception_ptr err; size_t errAt = 0;
+};
+
+} // namespace supercalc::detail
@@ -0,0 +1,110 @@
+// Selección en tiempo de ejecución de los núcleos vectoriales y tabla escalar
+// de respaldo (bucles sobre libm) para CPUs o compilaciones sin SIMD x86.
+#include "simd.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(SUPERCALC_X86_SIMD) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace supercalc::detail {
+
+namespace {
+
+#define SC_BIN(name, expr) \
+    void name##VV(const double* a, const double* b, double* o, size_t n){ for(size_t i=0;i<n;++i){ double x=a[i], y=b[i]; o[i]=(expr); } } \
+    void name##VS(const double* a, double y, double* o, size_t n){ for(size_t i=0;i<n;++i){ double x=a[i]; o[i]=(expr); } }
+#define SC_RBIN(name, expr) \
+    void name##SV(double x, const double* b, double* o, size_t n){ for(size_t i=0;i<n;++i){ double y=b[i]; o[i]=(expr); } }
+SC_BIN(add, x+y)
+SC_BIN(sub, x-y)
+SC_RBIN(sub, x-y)
+SC_BIN(mul, x*y)
+SC_BIN(div, x/y)
+SC_RBIN(div, x/y)
+SC_BIN(pow, std::pow(x,y))
+SC_RBIN(pow, std::pow(x,y))
+#undef SC_BIN
+#undef SC_RBIN
+
+#define SC_UN(name, expr) void name##U(const double* a, double* o, size_t n){ for(size_t i=0;i<n;++i){ double x=a[i]; o[i]=(expr); } }
+SC_UN(neg, -x)
+SC_UN(sin, std::sin(x))
+SC_UN(cos, std::cos(x))
+SC_UN(tan, std::tan(x))
+SC_UN(exp, std::exp(x))
+SC_UN(ln, std::log(x))
+SC_UN(log10, std::log10(x))
+SC_UN(sqrt, std::sqrt(x))
+SC_UN(cbrt, std::cbrt(x))
+SC_UN(abs, std::fabs(x))
+SC_UN(floor, std::floor(x))
+SC_UN(ceil, std::ceil(x))
+SC_UN(round, std::round(x))
+#undef SC_UN
+
+const SimdKernels SCALAR = {
+    "scalar",
+    addVV, subVV, mulVV, divVV, powVV,
+    addVS, subVS, mulVS, divVS, powVS,
+    subSV, divSV, powSV,
+    negU, sinU, cosU, tanU, expU, lnU, log10U, sqrtU, cbrtU, absU, floorU, ceilU, roundU
+};
+
+#if defined(SUPERCALC_X86_SIMD)
+bool cpuHasAVX2(){
+#if defined(_MSC_VER)
+    int r[4]; __cpuid(r, 1);
+    bool osxsave = (r[2] & (1<<27)) != 0, fma = (r[2] & (1<<12)) != 0;
+    if(!osxsave || !fma || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(r, 7, 0); return (r[1] & (1<<5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+bool cpuHasAVX512(){
+#if defined(_MSC_VER)
+    if(!cpuHasAVX2() || (_xgetbv(0) & 0xE6) != 0xE6) return false;
+    int r[4]; __cpuidex(r, 7, 0); return (r[1] & (1<<16)) != 0;
+#else
+    return __builtin_cpu_supports("avx512f");
+#endif
+}
+#endif
+
+} // namespace
+
+const SimdKernels* simdKernelsFor(const char* isa){
+    if(!std::strcmp(isa, "scalar")) return &SCALAR;
+#if defined(SUPERCALC_X86_SIMD)
+    if(!std::strcmp(isa, "sse2")){
+        // Sin FMA, exp/cbrt/pow vectoriales (doble-doble emulado) son más lentos que libm.
+        static const SimdKernels sse2 = []{
+            SimdKernels k = simdKernelsSSE2();
+            k.exp = SCALAR.exp; k.cbrt = SCALAR.cbrt;
+            k.pow = SCALAR.pow; k.pows = SCALAR.pows; k.rpow = SCALAR.rpow;
+            return k;
+        }();
+        return &sse2;
+    }
+    if(!std::strcmp(isa, "avx2") && cpuHasAVX2()) return &simdKernelsAVX2();
+    if(!std::strcmp(isa, "avx512") && cpuHasAVX512()) return &simdKernelsAVX512();
+#endif
+    return nullptr;
+}
+
+const SimdKernels& simdKernels(){
+    static const SimdKernels& best = []() -> const SimdKernels& {
+        if(const char* forced = std::getenv("SUPERCALC_SIMD"))
+            if(const SimdKernels* k = simdKernelsFor(forced)) return *k;
+        static const char* const order[] = { "avx512", "avx2", "sse2" };
+        for(const char* isa: order)
+            if(const SimdKernels* k = simdKernelsFor(isa)) return *k;
+        return SCALAR;
+    }();
+    return best;
+}
+
+} // namespace supercalc::detail
@@ -0,0 +1,46 @@
+// --- Núcleos vectoriales para la evaluación por columnas ---
+// Cada ISA (SSE2, AVX2+FMA, AVX-512F) se compila en su propia unidad con sus
+// flags; en tiempo de ejecución simdKernels() elige la mejor que soporta la CPU.
+// La variable de entorno SUPERCALC_SIMD=scalar|sse2|avx2|avx512 fuerza una.
+//
+// Contrato de precisión, en ULP frente al resultado escalar de libm (medido
+// sobre entradas aleatorias en todo el rango y casos límite):
+//   + - * / u-, sqrt, abs, floor, ceil, round ....... 0 (operación IEEE exacta)
+//   exp, ln, ^ (pow) .................................. <= 1
+//   log10, sin, cos ................................... <= 2
+//   cbrt .............................................. <= 3 (glibc se desvía hasta 3
+//                                                         del valor exacto; el núcleo, <= 1)
+//   tan ............................................... <= 4
+// sin/cos/tan usan la ruta vectorial para |x| <= 1e5 y libm para el resto; pow
+// usa libm en los carriles con base <= 0, valores no finitos o desbordamiento.
+// NaN, ±inf, ±0 y subnormales siguen la semántica de libm. SSE2 no tiene FMA:
+// sus resultados pueden diferir en 1 ULP de los de AVX2/AVX-512, y para exp,
+// cbrt y pow usa libm porque la emulación resulta más lenta.
+#pragma once
+#include <cstddef>
+
+namespace supercalc::detail {
+
+using SimdUnary = void(*)(const double* a, double* out, size_t n);
+using SimdBinVV = void(*)(const double* a, const double* b, double* out, size_t n);
+using SimdBinVS = void(*)(const double* a, double b, double* out, size_t n);
+using SimdBinSV = void(*)(double a, const double* b, double* out, size_t n);
+
+struct SimdKernels {
+    const char* isa;
+    SimdBinVV add, sub, mul, div, pow;
+    SimdBinVS adds, subs, muls, divs, pows;  // a op escalar
+    SimdBinSV rsub, rdiv, rpow;              // escalar op b
+    SimdUnary neg, sin, cos, tan, exp, ln, log10, sqrt, cbrt, abs, floor, ceil, round;
+};
+
+const SimdKernels& simdKernels();              // la mejor disponible (se decide una vez)
+const SimdKernels* simdKernelsFor(const char* isa); // nullptr si la CPU/compilación no la soporta
+
+#if defined(SUPERCALC_X86_SIMD)
+const SimdKernels& simdKernelsSSE2();
+const SimdKernels& simdKernelsAVX2();
+const SimdKernels& simdKernelsAVX512();
+#endif
+
+} // namespace supercalc::detail
@@ -0,0 +1,47 @@
+// Núcleos AVX2 + FMA (4 carriles). Se compila con -mavx2 -mfma (/arch:AVX2).
+#include "simd.hpp"
+#include <immintrin.h>
+#include <cstdint>
+
+namespace {
+struct T {
+    using V = __m256d; using M = __m256d;
+    static constexpr size_t N = 4; static constexpr bool kFMA = true;
+    static V load(const double* p){ return _mm256_loadu_pd(p); }
+    static void store(double* p, V v){ _mm256_storeu_pd(p, v); }
+    static V set1(double d){ return _mm256_set1_pd(d); }
+    static V bits(uint64_t b){ return _mm256_castsi256_pd(_mm256_set1_epi64x((long long)b)); }
+    static V add(V a, V b){ return _mm256_add_pd(a,b); }
+    static V sub(V a, V b){ return _mm256_sub_pd(a,b); }
+    static V mul(V a, V b){ return _mm256_mul_pd(a,b); }
+    static V div(V a, V b){ return _mm256_div_pd(a,b); }
+    static V fma(V a, V b, V c){ return _mm256_fmadd_pd(a,b,c); }
+    static V sqrt(V a){ return _mm256_sqrt_pd(a); }
+    static V min(V a, V b){ return _mm256_min_pd(a,b); }
+    static V max(V a, V b){ return _mm256_max_pd(a,b); }
+    static V and_(V a, V b){ return _mm256_and_pd(a,b); }
+    static V or_(V a, V b){ return _mm256_or_pd(a,b); }
+    static V xor_(V a, V b){ return _mm256_xor_pd(a,b); }
+    static V andnot(V a, V b){ return _mm256_andnot_pd(a,b); } // ~a & b
+    static V shl52(V a){ return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(a), 52)); }
+    static V shr52(V a){ return _mm256_castsi256_pd(_mm256_srli_epi64(_mm256_castpd_si256(a), 52)); }
+    static M lt(V a, V b){ return _mm256_cmp_pd(a,b,_CMP_LT_OQ); }
+    static M le(V a, V b){ return _mm256_cmp_pd(a,b,_CMP_LE_OQ); }
+    static M gt(V a, V b){ return _mm256_cmp_pd(a,b,_CMP_GT_OQ); }
+    static M ge(V a, V b){ return _mm256_cmp_pd(a,b,_CMP_GE_OQ); }
+    static M eq(V a, V b){ return _mm256_cmp_pd(a,b,_CMP_EQ_OQ); }
+    static V select(M m, V a, V b){ return _mm256_blendv_pd(b, a, m); }
+    static M mand(M a, M b){ return _mm256_and_pd(a,b); }
+    static M mor(M a, M b){ return _mm256_or_pd(a,b); }
+    static M mnot(M a){ return _mm256_xor_pd(a, _mm256_castsi256_pd(_mm256_set1_epi32(-1))); }
+    static int movemask(M m){ return _mm256_movemask_pd(m); }
+    static V rint(V x){ return _mm256_round_pd(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static V floor(V x){ return _mm256_round_pd(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+    static V ceil(V x){ return _mm256_round_pd(x, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC); }
+    static V trunc(V x){ return _mm256_round_pd(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+};
+} // namespace
+
+#define SC_SIMD_ISA "avx2"
+#define SC_SIMD_TABLE simdKernelsAVX2
+#include "simd_kernels.inl"
@@ -0,0 +1,56 @@
+// Núcleos AVX-512F (8 carriles, máscaras en registros k). Se compila con
+// -mavx512f -mfma (/arch:AVX512).
+#include "simd.hpp"
+// GCC 12 avisa en falso de __Y sin inicializar dentro de avx512fintrin.h (PR 105593)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+#include <cstdint>
+
+namespace {
+struct T {
+    using V = __m512d; using M = __mmask8;
+    static constexpr size_t N = 8; static constexpr bool kFMA = true;
+    static __m512i i(V a){ return _mm512_castpd_si512(a); }
+    static V d(__m512i a){ return _mm512_castsi512_pd(a); }
+    static V load(const double* p){ return _mm512_loadu_pd(p); }
+    static void store(double* p, V v){ _mm512_storeu_pd(p, v); }
+    static V set1(double x){ return _mm512_set1_pd(x); }
+    static V bits(uint64_t b){ return d(_mm512_set1_epi64((long long)b)); }
+    static V add(V a, V b){ return _mm512_add_pd(a,b); }
+    static V sub(V a, V b){ return _mm512_sub_pd(a,b); }
+    static V mul(V a, V b){ return _mm512_mul_pd(a,b); }
+    static V div(V a, V b){ return _mm512_div_pd(a,b); }
+    static V fma(V a, V b, V c){ return _mm512_fmadd_pd(a,b,c); }
+    static V sqrt(V a){ return _mm512_sqrt_pd(a); }
+    static V min(V a, V b){ return _mm512_min_pd(a,b); }
+    static V max(V a, V b){ return _mm512_max_pd(a,b); }
+    // las operaciones lógicas sobre pd son AVX-512DQ; con F se usan las enteras
+    static V and_(V a, V b){ return d(_mm512_and_epi64(i(a), i(b))); }
+    static V or_(V a, V b){ return d(_mm512_or_epi64(i(a), i(b))); }
+    static V xor_(V a, V b){ return d(_mm512_xor_epi64(i(a), i(b))); }
+    static V andnot(V a, V b){ return d(_mm512_andnot_epi64(i(a), i(b))); } // ~a & b
+    static V shl52(V a){ return d(_mm512_slli_epi64(i(a), 52)); }
+    static V shr52(V a){ return d(_mm512_srli_epi64(i(a), 52)); }
+    static M lt(V a, V b){ return _mm512_cmp_pd_mask(a,b,_CMP_LT_OQ); }
+    static M le(V a, V b){ return _mm512_cmp_pd_mask(a,b,_CMP_LE_OQ); }
+    static M gt(V a, V b){ return _mm512_cmp_pd_mask(a,b,_CMP_GT_OQ); }
+    static M ge(V a, V b){ return _mm512_cmp_pd_mask(a,b,_CMP_GE_OQ); }
+    static M eq(V a, V b){ return _mm512_cmp_pd_mask(a,b,_CMP_EQ_OQ); }
+    static V select(M m, V a, V b){ return _mm512_mask_blend_pd(m, b, a); }
+    static M mand(M a, M b){ return (M)(a & b); }
+    static M mor(M a, M b){ return (M)(a | b); }
+    static M mnot(M a){ return (M)~a; }
+    static int movemask(M m){ return (int)m; }
+    static V rint(V x){ return _mm512_roundscale_pd(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static V floor(V x){ return _mm512_roundscale_pd(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+    static V ceil(V x){ return _mm512_roundscale_pd(x, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC); }
+    static V trunc(V x){ return _mm512_roundscale_pd(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+};
+} // namespace
+
+#define SC_SIMD_ISA "avx512"
+#define SC_SIMD_TABLE simdKernelsAVX512
+#include "simd_kernels.inl"
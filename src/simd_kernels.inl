@@ -0,0 +1,331 @@
+// --- Cuerpo común de los núcleos vectoriales ---
+// Lo incluye cada simd_<isa>.cpp después de definir, dentro de un espacio de
+// nombres anónimo, la estructura de rasgos T (tipo V, máscara M, N carriles y
+// las operaciones básicas) y las macros SC_SIMD_ISA (nombre) y SC_SIMD_TABLE
+// (función que devuelve la tabla). Todo lo que se define aquí tiene enlace
+// interno: cada unidad se compila con flags distintos y no deben mezclarse.
+// No usar plantillas de la biblioteca estándar aquí por el mismo motivo.
+
+#include <cmath>
+#include <cstdint>
+
+namespace supercalc::detail {
+
+namespace {
+
+using V = T::V;
+using M = T::M;
+
+inline V vc(double c){ return T::set1(c); }
+inline V signOf(V x){ return T::and_(x, T::bits(0x8000000000000000ull)); }
+inline V vneg(V x){ return T::xor_(x, T::bits(0x8000000000000000ull)); }
+inline V vabs(V x){ return T::andnot(T::bits(0x8000000000000000ull), x); }
+inline M nanMask(V x){ return T::mnot(T::eq(x, x)); }
+
+template<int K> inline V horner(V x, const double (&c)[K]){
+    V r = vc(c[K-1]);
+    for(int i=K-2;i>=0;--i) r = T::fma(r, x, vc(c[i]));
+    return r;
+}
+
+// 2^n para n entero en [-1022, 1023] (n en un double).
+inline V pow2(V n){ return T::shl52(T::add(n, vc(4503599627371519.0))); } // 2^52 + 1023
+// 2^n en dos pasos para cubrir resultados subnormales o n = 1024.
+inline V scale2(V x, V n){
+    V n1 = T::floor(T::mul(n, vc(0.5)));
+    return T::mul(T::mul(x, pow2(n1)), pow2(T::sub(n, n1)));
+}
+// Exponente sin sesgo y mantisa en [1,2) de un x > 0 normal.
+inline V exponentOf(V x){
+    V e = T::or_(T::shr52(x), T::bits(0x4330000000000000ull));
+    return T::sub(e, vc(4503599627371519.0)); // 2^52 + 1023
+}
+inline V mantissaOf(V x){
+    return T::or_(T::and_(x, T::bits(0x000FFFFFFFFFFFFFull)), T::bits(0x3FF0000000000000ull));
+}
+
+// --- Aritmética doble-doble (para pow) ---
+struct DD { V hi, lo; };
+inline DD twoSum(V a, V b){
+    V s = T::add(a,b), bb = T::sub(s,a);
+    return { s, T::add(T::sub(a, T::sub(s,bb)), T::sub(b,bb)) };
+}
+inline DD fastTwoSum(V a, V b){ V s = T::add(a,b); return { s, T::sub(b, T::sub(s,a)) }; } // |a| >= |b|
+inline DD twoProd(V a, V b){
+    V p = T::mul(a,b);
+    if(T::kFMA) return { p, T::fma(a, b, vneg(p)) };
+    // Dekker: partir en mitades de 26 bits
+    const V split = vc(134217729.0);
+    V ca = T::mul(a, split), ah = T::sub(ca, T::sub(ca, a)), al = T::sub(a, ah);
+    V cb = T::mul(b, split), bh = T::sub(cb, T::sub(cb, b)), bl = T::sub(b, bh);
+    V err = T::add(T::add(T::add(T::sub(T::mul(ah,bh), p), T::mul(ah,bl)), T::mul(al,bh)), T::mul(al,bl));
+    return { p, err };
+}
+inline DD ddAdd(DD a, DD b){ DD s = twoSum(a.hi, b.hi); return fastTwoSum(s.hi, T::add(s.lo, T::add(a.lo, b.lo))); }
+inline DD ddMul(DD a, DD b){
+    DD p = twoProd(a.hi, b.hi);
+    return fastTwoSum(p.hi, T::add(p.lo, T::add(T::mul(a.hi, b.lo), T::mul(a.lo, b.hi))));
+}
+inline DD ddMulD(DD a, V b){ DD p = twoProd(a.hi, b); return fastTwoSum(p.hi, T::add(p.lo, T::mul(a.lo, b))); }
+
+// --- Funciones elementales ---
+const double LN2_HI = 6.93147180369123816490e-01, LN2_LO = 1.90821492927058770002e-10;
+
+inline V vround(V x){ // mitades lejos de cero, como std::round
+    V t = T::trunc(x);
+    M up = T::ge(vabs(T::sub(x, t)), vc(0.5));
+    return T::select(up, T::add(t, T::or_(vc(1.0), signOf(x))), t);
+}
+
+inline V vexp(V x){
+    V xc = T::min(T::max(x, vc(-746.0)), vc(710.0)); // fuera de aquí el resultado ya es 0 o inf
+    V n = T::rint(T::mul(xc, vc(1.4426950408889634)));
+    V rh = T::fma(vneg(n), vc(LN2_HI), xc);            // exacta
+    DD r = twoSum(rh, vneg(T::mul(n, vc(LN2_LO))));
+    static const double P[] = { 1.0/2, 1.0/6, 1.0/24, 1.0/120, 1.0/720, 1.0/5040, 1.0/40320, 1.0/362880,
+        1.0/3628800, 1.0/39916800, 1.0/479001600, 1.0/6227020800.0, 1.0/87178291200.0 };
+    V q = T::fma(T::mul(r.hi, r.hi), horner(r.hi, P), r.lo);
+    DD h = fastTwoSum(vc(1.0), r.hi);
+    V res = scale2(T::add(h.hi, T::add(h.lo, q)), n);
+    return T::select(nanMask(x), x, res);
+}
+
+// Reducción común de ln/log10: x = 2^e * (1+f), 1+f en [sqrt(1/2), sqrt(2)).
+// Devuelve log(1+f) separado como f - (hfsq - s*(hfsq+R)) (algoritmo de fdlibm).
+struct LogParts { V e, f, hfsq, sR; };
+inline LogParts logReduce(V x){
+    M sub = T::lt(x, vc(2.2250738585072014e-308));
+    V xs = T::select(sub, T::mul(x, vc(18014398509481984.0)), x); // 2^54
+    V e = T::add(exponentOf(xs), T::select(sub, vc(-54.0), vc(0.0)));
+    V m = mantissaOf(xs);
+    M big = T::gt(m, vc(1.4142135623730951));
+    m = T::select(big, T::mul(m, vc(0.5)), m);
+    e = T::select(big, T::add(e, vc(1.0)), e);
+    const double Lg1 = 6.666666666666735130e-01, Lg2 = 3.999999999940941908e-01, Lg3 = 2.857142874366239149e-01,
+                 Lg4 = 2.222219843214978396e-01, Lg5 = 1.818357216161805012e-01, Lg6 = 1.531383769920937332e-01,
+                 Lg7 = 1.479819860511658591e-01;
+    V f = T::sub(m, vc(1.0));
+    V hfsq = T::mul(vc(0.5), T::mul(f, f));
+    V s = T::div(f, T::add(vc(2.0), f));
+    V z = T::mul(s, s), w = T::mul(z, z);
+    V t1 = T::mul(w, T::fma(w, T::fma(w, vc(Lg6), vc(Lg4)), vc(Lg2)));
+    V t2 = T::mul(z, T::fma(w, T::fma(w, T::fma(w, vc(Lg7), vc(Lg5)), vc(Lg3)), vc(Lg1)));
+    return { e, f, hfsq, T::mul(s, T::add(hfsq, T::add(t2, t1))) };
+}
+inline V logSpecials(V x, V r){
+    r = T::select(T::eq(x, vc(0.0)), vc(-INFINITY), r);
+    r = T::select(T::lt(x, vc(0.0)), vc(NAN), r);
+    r = T::select(T::eq(x, vc(INFINITY)), x, r);
+    return T::select(nanMask(x), x, r);
+}
+inline V vlog(V x){
+    LogParts p = logReduce(x);
+    V r = T::sub(T::mul(p.e, vc(LN2_HI)),
+                 T::sub(T::sub(p.hfsq, T::fma(p.e, vc(LN2_LO), p.sR)), p.f));
+    return logSpecials(x, r);
+}
+inline V vlog10(V x){
+    LogParts p = logReduce(x);
+    V lm = T::sub(p.f, T::sub(p.hfsq, p.sR));
+    V r = T::fma(p.e, vc(3.01029995663611771306e-01),
+                 T::fma(p.e, vc(3.69423907715893078616e-13), T::mul(vc(4.34294481903251816668e-01), lm)));
+    return logSpecials(x, r);
+}
+
+// sin/cos/tan: reducción de Cody-Waite con pi/2 en cuatro partes (las tres
+// primeras de 33 bits, así n*P_k es exacto para |n| < 2^20). Válida hasta 1e5;
+// el resto de carriles se completa con libm.
+const double TRIG_LIMIT = 1e5;
+struct TrigParts { V s, c, q; M odd; };
+inline TrigParts trigReduce(V x){
+    V n = T::rint(T::mul(x, vc(0.63661977236758134)));
+    V r = T::fma(vneg(n), vc(1.5707963267341256), x);
+    r = T::fma(vneg(n), vc(6.077100506303966e-11), r);
+    r = T::fma(vneg(n), vc(2.0222662487111665e-21), r);
+    r = T::fma(vneg(n), vc(8.4784276603689e-32), r);
+    V q = T::sub(n, T::mul(vc(4.0), T::floor(T::mul(n, vc(0.25))))); // n mod 4 en {0,1,2,3}
+    // núcleos de fdlibm (__kernel_sin/__kernel_cos) sobre |r| <= pi/4
+    V z = T::mul(r, r);
+    V rs = T::fma(z, T::fma(z, T::fma(z, T::fma(z, vc(1.58969099521155010221e-10), vc(-2.50507602534068634195e-08)),
+                     vc(2.75573137070700676789e-06)), vc(-1.98412698298579493134e-04)), vc(8.33333333332248946124e-03));
+    V s = T::fma(T::mul(z, r), T::fma(z, rs, vc(-1.66666666666666324348e-01)), r);
+    V rc = T::mul(z, T::fma(z, T::fma(z, T::fma(z, T::fma(z, T::fma(z, vc(-1.13596475577881948265e-11), vc(2.08757232129817482790e-09)),
+                     vc(-2.75573143513906633035e-07)), vc(2.48015872894767294178e-05)), vc(-1.38888888888741095749e-03)), vc(4.16666666666666019037e-02)));
+    V hz = T::mul(vc(0.5), z), w = T::sub(vc(1.0), hz);
+    V c = T::add(w, T::fma(z, rc, T::sub(T::sub(vc(1.0), w), hz)));
+    return { s, c, q, T::mor(T::eq(q, vc(1.0)), T::eq(q, vc(3.0))) };
+}
+template<class F> inline V trigFallback(V x, V r, F libm){
+    M bad = T::mnot(T::le(vabs(x), vc(TRIG_LIMIT))); // incluye inf y NaN
+    int mask = T::movemask(bad);
+    if(!mask) return r;
+    double xs[T::N], rs[T::N];
+    T::store(xs, x); T::store(rs, r);
+    for(size_t j=0;j<T::N;++j) if(mask & (1<<j)) rs[j] = libm(xs[j]);
+    return T::load(rs);
+}
+inline V vsin(V x){
+    TrigParts t = trigReduce(x);
+    V r = T::select(t.odd, t.c, t.s);                  // q: 0 s, 1 c, 2 -s, 3 -c
+    r = T::select(T::ge(t.q, vc(2.0)), vneg(r), r);
+    r = T::select(T::eq(x, vc(0.0)), x, r); // conserva -0
+    return trigFallback(x, r, [](double a){ return std::sin(a); });
+}
+inline V vcos(V x){
+    TrigParts t = trigReduce(x);
+    V r = T::select(t.odd, t.s, t.c);                  // q: 0 c, 1 -s, 2 -c, 3 s
+    r = T::select(T::mor(T::eq(t.q, vc(1.0)), T::eq(t.q, vc(2.0))), vneg(r), r);
+    return trigFallback(x, r, [](double a){ return std::cos(a); });
+}
+inline V vtan(V x){
+    TrigParts t = trigReduce(x);
+    V r = T::select(t.odd, vneg(T::div(t.c, t.s)), T::div(t.s, t.c));
+    r = T::select(T::eq(x, vc(0.0)), x, r);
+    return trigFallback(x, r, [](double a){ return std::tan(a); });
+}
+
+inline V vcbrt(V x){
+    V ax = vabs(x);
+    M sub = T::lt(ax, vc(2.2250738585072014e-308));
+    V axs = T::select(sub, T::mul(ax, vc(18014398509481984.0)), ax); // 2^54
+    V e = T::add(exponentOf(axs), T::select(sub, vc(-54.0), vc(0.0)));
+    V k = T::floor(T::div(e, vc(3.0)));
+    V rem = T::sub(e, T::mul(vc(3.0), k));
+    V a = T::mul(mantissaOf(axs), T::select(T::eq(rem, vc(0.0)), vc(1.0), T::select(T::eq(rem, vc(1.0)), vc(2.0), vc(4.0))));
+    // aproximación cúbica en [1,8) (error relativo 1.4e-2) y dos pasos de Halley
+    V y = T::fma(a, T::fma(a, T::fma(a, vc(0.0019174280218888235), vc(-0.03750771048717574)), vc(0.3400752780944755)), vc(0.7090571020791024));
+    for(int it=0; it<2; ++it){
+        V y3 = T::mul(T::mul(y, y), y);
+        y = T::div(T::mul(y, T::fma(vc(2.0), a, y3)), T::fma(vc(2.0), y3, a));
+    }
+    // redondear a 21 bits (Veltkamp) y paso final de fdlibm: error < 0.667 ulp
+    V cs = T::mul(y, vc(4294967297.0));
+    V t = T::sub(cs, T::sub(cs, y));
+    V s = T::mul(t, t);
+    V r = T::div(a, s);
+    r = T::div(T::sub(r, t), T::add(T::add(t, t), r));
+    t = T::fma(t, r, t);
+    V res = T::or_(T::mul(t, pow2(k)), signOf(x));
+    M special = T::mor(T::eq(ax, vc(0.0)), T::mnot(T::lt(ax, vc(INFINITY)))); // ±0, ±inf, NaN
+    return T::select(special, x, res);
+}
+
+// pow(x,y) = exp(y*log(x)) en doble-doble para x > 0 finito; el resto de
+// carriles (bases negativas o nulas, no finitos, desbordamientos) van a libm.
+inline DD logDD(V x){
+    M sub = T::lt(x, vc(2.2250738585072014e-308));
+    V xs = T::select(sub, T::mul(x, vc(18014398509481984.0)), x);
+    V e = T::add(exponentOf(xs), T::select(sub, vc(-54.0), vc(0.0)));
+    V m = mantissaOf(xs);
+    M big = T::gt(m, vc(1.4142135623730951));
+    m = T::select(big, T::mul(m, vc(0.5)), m);
+    e = T::select(big, T::add(e, vc(1.0)), e);
+    // log(m) = 2 atanh(t), t = (m-1)/(m+1); |t| <= 0.1716
+    V num = T::sub(m, vc(1.0));
+    DD den = twoSum(m, vc(1.0));
+    V q1 = T::div(num, den.hi);
+    DD p = twoProd(q1, den.hi);
+    V q2 = T::div(T::sub(T::sub(T::sub(num, p.hi), p.lo), T::mul(q1, den.lo)), den.hi);
+    DD t = fastTwoSum(q1, q2);
+    DD t2 = ddMul(t, t), t3 = ddMul(t2, t);
+    static const double Q[] = { 2.0/5, 2.0/7, 2.0/9, 2.0/11, 2.0/13, 2.0/15, 2.0/17, 2.0/19, 2.0/21, 2.0/23, 2.0/25, 2.0/27 };
+    V tail = T::mul(T::mul(t3.hi, t2.hi), horner(t2.hi, Q));
+    DD l = twoProd(e, vc(0.69314718055994529));
+    l.lo = T::fma(e, vc(2.3190468138462996e-17), l.lo);
+    l = ddAdd(l, DD{ T::add(t.hi, t.hi), T::add(t.lo, t.lo) });
+    l = ddAdd(l, ddMul(t3, DD{ vc(0.66666666666666663), vc(3.7007434154171886e-17) }));
+    return ddAdd(l, DD{ tail, vc(0.0) });
+}
+inline V expDD(DD d){
+    V n = T::rint(T::mul(d.hi, vc(1.4426950408889634)));
+    V sh = T::fma(vneg(n), vc(LN2_HI), d.hi);        // exacta
+    DD s = twoSum(sh, vneg(T::mul(n, vc(LN2_LO))));
+    s = twoSum(s.hi, T::add(s.lo, d.lo));
+    static const double P[] = { 1.0/2, 1.0/6, 1.0/24, 1.0/120, 1.0/720, 1.0/5040, 1.0/40320, 1.0/362880,
+        1.0/3628800, 1.0/39916800, 1.0/479001600, 1.0/6227020800.0, 1.0/87178291200.0 };
+    // e^(hi+lo) ~= e^hi * (1 + lo), con e^hi - 1 ~= hi en el término de lo
+    V q = T::fma(T::mul(s.hi, s.hi), horner(s.hi, P), T::fma(s.lo, s.hi, s.lo));
+    DD h = fastTwoSum(vc(1.0), s.hi);
+    return scale2(T::add(h.hi, T::add(h.lo, q)), n);
+}
+inline V vpow(V x, V y){
+    DD d = ddMulD(logDD(x), y);
+    V r = expDD(d);
+    M ok = T::mand(T::mand(T::gt(x, vc(0.0)), T::lt(x, vc(INFINITY))),
+                   T::mand(T::lt(vabs(y), vc(INFINITY)), T::lt(vabs(d.hi), vc(708.0))));
+    int mask = T::movemask(T::mnot(ok));
+    if(!mask) return r;
+    double xs[T::N], ys[T::N], rs[T::N];
+    T::store(xs, x); T::store(ys, y); T::store(rs, r);
+    for(size_t j=0;j<T::N;++j) if(mask & (1<<j)) rs[j] = std::pow(xs[j], ys[j]);
+    return T::load(rs);
+}
+
+// --- Bucles sobre bloques; la cola se completa en un búfer de N carriles ---
+template<class F> inline void map1(const double* a, double* o, size_t n, F f){
+    size_t i=0;
+    for(; i+T::N<=n; i+=T::N) T::store(o+i, f(T::load(a+i)));
+    if(i<n){
+        double ta[T::N] = {0}, to[T::N];
+        for(size_t j=0;i+j<n;++j) ta[j] = a[i+j];
+        T::store(to, f(T::load(ta)));
+        for(size_t j=0;i+j<n;++j) o[i+j] = to[j];
+    }
+}
+template<class F> inline void map2(const double* a, const double* b, double* o, size_t n, F f){
+    size_t i=0;
+    for(; i+T::N<=n; i+=T::N) T::store(o+i, f(T::load(a+i), T::load(b+i)));
+    if(i<n){
+        double ta[T::N] = {0}, tb[T::N] = {0}, to[T::N];
+        for(size_t j=0;i+j<n;++j){ ta[j] = a[i+j]; tb[j] = b[i+j]; }
+        T::store(to, f(T::load(ta), T::load(tb)));
+        for(size_t j=0;i+j<n;++j) o[i+j] = to[j];
+    }
+}
+
+#define SC_BIN(name, expr) \
+    void name##VV(const double* a, const double* b, double* o, size_t n){ map2(a, b, o, n, [](V x, V y){ return expr; }); } \
+    void name##VS(const double* a, double s, double* o, size_t n){ V y = vc(s); map1(a, o, n, [y](V x){ return expr; }); }
+#define SC_RBIN(name, expr) \
+    void name##SV(double s, const double* b, double* o, size_t n){ V x = vc(s); map1(b, o, n, [x](V y){ return expr; }); }
+SC_BIN(add, T::add(x, y))
+SC_BIN(sub, T::sub(x, y))
+SC_RBIN(sub, T::sub(x, y))
+SC_BIN(mul, T::mul(x, y))
+SC_BIN(div, T::div(x, y))
+SC_RBIN(div, T::div(x, y))
+SC_BIN(pow, vpow(x, y))
+SC_RBIN(pow, vpow(x, y))
+#undef SC_BIN
+#undef SC_RBIN
+
+#define SC_UN(name, expr) void name##U(const double* a, double* o, size_t n){ map1(a, o, n, [](V x){ return expr; }); }
+SC_UN(neg, vneg(x))
+SC_UN(sin, vsin(x))
+SC_UN(cos, vcos(x))
+SC_UN(tan, vtan(x))
+SC_UN(exp, vexp(x))
+SC_UN(ln, vlog(x))
+SC_UN(log10, vlog10(x))
+SC_UN(sqrt, T::sqrt(x))
+SC_UN(cbrt, vcbrt(x))
+SC_UN(abs, vabs(x))
+SC_UN(floor, T::floor(x))
+SC_UN(ceil, T::ceil(x))
+SC_UN(round, vround(x))
+#undef SC_UN
+
+} // namespace
+
+const SimdKernels& SC_SIMD_TABLE(){
+    static const SimdKernels k = {
+        SC_SIMD_ISA,
+        addVV, subVV, mulVV, divVV, powVV,
+        addVS, subVS, mulVS, divVS, powVS,
+        subSV, divSV, powSV,
+        negU, sinU, cosU, tanU, expU, lnU, log10U, sqrtU, cbrtU, absU, floorU, ceilU, roundU
+    };
+    return k;
+}
+
+} // namespace supercalc::detail
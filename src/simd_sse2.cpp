@@ -0,0 +1,59 @@
+// Núcleos SSE2 (base de x86-64): sin FMA ni redondeo vectorial, que se emulan.
+#include "simd.hpp"
+#include <emmintrin.h>
+#include <cstdint>
+
+namespace {
+struct T {
+    using V = __m128d; using M = __m128d;
+    static constexpr size_t N = 2; static constexpr bool kFMA = false;
+    static V load(const double* p){ return _mm_loadu_pd(p); }
+    static void store(double* p, V v){ _mm_storeu_pd(p, v); }
+    static V set1(double d){ return _mm_set1_pd(d); }
+    static V bits(uint64_t b){ return _mm_castsi128_pd(_mm_set1_epi64x((long long)b)); }
+    static V add(V a, V b){ return _mm_add_pd(a,b); }
+    static V sub(V a, V b){ return _mm_sub_pd(a,b); }
+    static V mul(V a, V b){ return _mm_mul_pd(a,b); }
+    static V div(V a, V b){ return _mm_div_pd(a,b); }
+    static V fma(V a, V b, V c){ return _mm_add_pd(_mm_mul_pd(a,b), c); }
+    static V sqrt(V a){ return _mm_sqrt_pd(a); }
+    static V min(V a, V b){ return _mm_min_pd(a,b); }
+    static V max(V a, V b){ return _mm_max_pd(a,b); }
+    static V and_(V a, V b){ return _mm_and_pd(a,b); }
+    static V or_(V a, V b){ return _mm_or_pd(a,b); }
+    static V xor_(V a, V b){ return _mm_xor_pd(a,b); }
+    static V andnot(V a, V b){ return _mm_andnot_pd(a,b); } // ~a & b
+    static V shl52(V a){ return _mm_castsi128_pd(_mm_slli_epi64(_mm_castpd_si128(a), 52)); }
+    static V shr52(V a){ return _mm_castsi128_pd(_mm_srli_epi64(_mm_castpd_si128(a), 52)); }
+    static M lt(V a, V b){ return _mm_cmplt_pd(a,b); }
+    static M le(V a, V b){ return _mm_cmple_pd(a,b); }
+    static M gt(V a, V b){ return _mm_cmpgt_pd(a,b); }
+    static M ge(V a, V b){ return _mm_cmpge_pd(a,b); }
+    static M eq(V a, V b){ return _mm_cmpeq_pd(a,b); }
+    static V select(M m, V a, V b){ return _mm_or_pd(_mm_and_pd(m,a), _mm_andnot_pd(m,b)); }
+    static M mand(M a, M b){ return _mm_and_pd(a,b); }
+    static M mor(M a, M b){ return _mm_or_pd(a,b); }
+    static M mnot(M a){ return _mm_xor_pd(a, _mm_castsi128_pd(_mm_set1_epi32(-1))); }
+    static int movemask(M m){ return _mm_movemask_pd(m); }
+    // redondeo al par más cercano sumando y restando 2^52 (|x| >= 2^52 ya es entero)
+    static V rint(V x){
+        V sign = _mm_and_pd(x, bits(0x8000000000000000ull)), ax = _mm_xor_pd(x, sign);
+        V t = _mm_sub_pd(_mm_add_pd(ax, set1(4503599627370496.0)), set1(4503599627370496.0));
+        return select(_mm_cmplt_pd(ax, set1(4503599627370496.0)), _mm_or_pd(t, sign), x);
+    }
+    static V floor(V x){ V t = rint(x); return select(_mm_cmpgt_pd(t, x), _mm_sub_pd(t, set1(1.0)), t); }
+    static V ceil(V x){
+        V t = rint(x); t = select(_mm_cmplt_pd(t, x), _mm_add_pd(t, set1(1.0)), t);
+        return _mm_or_pd(t, _mm_and_pd(x, bits(0x8000000000000000ull))); // ceil(-0.5) = -0
+    }
+    static V trunc(V x){
+        V sign = _mm_and_pd(x, bits(0x8000000000000000ull)), ax = _mm_xor_pd(x, sign);
+        V t = rint(ax); t = select(_mm_cmpgt_pd(t, ax), _mm_sub_pd(t, set1(1.0)), t);
+        return select(_mm_cmplt_pd(ax, set1(4503599627370496.0)), _mm_or_pd(t, sign), x);
+    }
+};
+} // namespace
+
+#define SC_SIMD_ISA "sse2"
+#define SC_SIMD_TABLE simdKernelsSSE2
+#include "simd_kernels.inl"
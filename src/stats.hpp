@@ -0,0 +1,106 @@
+// --- Instrumentación por etapas (:stats) ---
+// Cada etapa de una línea del REPL (recorte, caché, análisis, compilación,
+// evaluación y salida) se mide con steady_clock y alimenta un histograma de
+// latencias con cubetas logarítmicas: 4 subdivisiones por potencia de 2, así que
+// los percentiles tienen un error relativo menor del 25% y registrar cuesta unas
+// pocas instrucciones. Con SUPERCALC_STATS=0 las macros no generan código.
+#pragma once
+#ifndef SUPERCALC_STATS
+#define SUPERCALC_STATS 0
+#endif
+
+#if SUPERCALC_STATS
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+
+enum class Stage : int { Trim, Cache, Parse, Compile, Eval, Format, Line, Count };
+
+struct LatencyHist {
+    static const int SUB = 4, BUCKETS = 4 + 62*SUB;
+    uint64_t buckets[BUCKETS] = {}, count = 0, sum = 0, max = 0;
+
+    static int msb(uint64_t v){
+#if defined(__GNUC__) || defined(__clang__)
+        return 63 - __builtin_clzll(v);
+#else
+        int m = 0; while(v >>= 1) ++m; return m;
+#endif
+    }
+    static int index(uint64_t v){
+        if(v < (uint64_t)SUB) return (int)v;
+        int m = msb(v);
+        return SUB + (m-2)*SUB + (int)((v >> (m-2)) & (SUB-1));
+    }
+    static uint64_t upper(int i){ // mayor valor que cae en la cubeta i
+        if(i < SUB) return (uint64_t)i;
+        int m = (i-SUB)/SUB + 2, sub = (i-SUB)%SUB;
+        return ((uint64_t)(SUB|sub) << (m-2)) + ((uint64_t)1 << (m-2)) - 1;
+    }
+    void add(uint64_t ns){ ++buckets[index(ns)]; ++count; sum += ns; if(ns > max) max = ns; }
+    uint64_t percentile(double q) const {
+        if(!count) return 0;
+        uint64_t target = (uint64_t)(q*(double)count + 0.999999), acc = 0;
+        for(int i=0;i<BUCKETS;++i){
+            acc += buckets[i];
+            if(acc >= target) return upper(i) < max ? upper(i) : max;
+        }
+        return max;
+    }
+};
+
+struct StageStats {
+    LatencyHist hist[(int)Stage::Count];
+    uint64_t lines = 0, errors = 0;
+    uint64_t hits0 = 0, misses0 = 0, allocs0 = 0; // contadores externos al hacer reset
+
+    // hits/misses/allocs: valores actuales de la caché y del contador de reservas.
+    void reset(uint64_t hits, uint64_t misses, uint64_t allocs){
+        *this = StageStats(); hits0 = hits; misses0 = misses; allocs0 = allocs;
+    }
+    void print(std::ostream& os, uint64_t hits, uint64_t misses, uint64_t allocs) const {
+        static const char* const names[] = { "recorte", "caché", "análisis", "compilación", "evaluación", "salida", "línea" };
+        // %-12s cuenta bytes, no caracteres: el relleno se hace a mano por el UTF-8
+        auto label = [&os](const char* n){
+            int w = 0; for(const char* c=n; *c; ++c) w += ((unsigned char)*c & 0xC0) != 0x80;
+            os << n; for(; w<12; ++w) os << ' ';
+        };
+        char row[160];
+        label("etapa");
+        std::snprintf(row, sizeof row, " %10s %10s %10s %10s %10s %10s   (ns)\n", "n", "media", "p50", "p99", "p999", "max");
+        os << row;
+        for(int s=0; s<(int)Stage::Count; ++s){
+            const LatencyHist& h = hist[s];
+            label(names[s]);
+            std::snprintf(row, sizeof row, " %10llu %10llu %10llu %10llu %10llu %10llu\n",
+                          (unsigned long long)h.count, (unsigned long long)(h.count ? h.sum/h.count : 0),
+                          (unsigned long long)h.percentile(0.50), (unsigned long long)h.percentile(0.99),
+                          (unsigned long long)h.percentile(0.999), (unsigned long long)h.max);
+            os << row;
+        }
+        os << "líneas=" << lines << " errores=" << errors << " aciertos=" << hits-hits0
+           << " fallos=" << misses-misses0 << " reservas=" << allocs-allocs0 << "\n";
+    }
+};
+
+// Un acumulador por hilo: el REPL lee el suyo y los hilos de --batch no compiten.
+inline StageStats& stageStats(){ thread_local StageStats s; return s; }
+
+struct StageTimer {
+    Stage stage; std::chrono::steady_clock::time_point t0;
+    explicit StageTimer(Stage s): stage(s), t0(std::chrono::steady_clock::now()) {}
+    ~StageTimer(){
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-t0).count();
+        stageStats().hist[(int)stage].add((uint64_t)ns);
+    }
+};
+
+#define SC_STAT_CAT2(a, b) a##b
+#define SC_STAT_CAT(a, b) SC_STAT_CAT2(a, b)
+#define SC_STAGE(s) StageTimer SC_STAT_CAT(sc_stage_, __LINE__)(Stage::s)
+#define SC_COUNT(field) (++stageStats().field)
+#else
+#define SC_STAGE(s) ((void)0)
+#define SC_COUNT(field) ((void)0)
+#endif
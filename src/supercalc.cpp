@@ -0,0 +1,290 @@
+// --- libsupercalc: implementación de la API (supercalc.hpp) sobre el motor ---
+#include "supercalc.hpp"
+#include "engine.hpp"
+#include <new>
+
+namespace supercalc {
+
+using namespace detail; // el motor; esta unidad solo exporta lo declarado en supercalc.hpp
+
+struct CompiledExpr {
+    Program prog;
+    const void* owner;
+    vector<uint32_t> vars; // ranuras que lee el programa (sin repetir)
+};
+
+struct Calculator::Impl {
+    Env env; ExprCache cache;
+    unique_ptr<WorkPool> pool;
+    string error;
+    vector<ColumnBinding> cols; // reutilizado entre llamadas a evalBatch
+    vector<uint32_t> seeds;     // ídem, evalDiff y evalGradient
+    GradTape tape; vector<double> grad;
+
+    Status fail(Status s, string msg){ error = move(msg); return s; }
+    // Traduce la excepción en curso a un Status. Solo se llama dentro de un catch.
+    Status fromException(){
+        try{ throw; }
+        catch(const CalcError& ex){ return fail((Status)ex.code, ex.what()); }
+        catch(const std::bad_alloc&){ return fail(Status::OutOfMemory, "Memoria insuficiente"); }
+        catch(const exception& ex){ return fail(Status::InvalidArgument, ex.what()); }
+        catch(...){ return fail(Status::InvalidArgument, "Error desconocido"); }
+    }
+    Status checkExpr(const Expression& e) {
+        if(!e.prog || e.prog->owner!=this) return fail(Status::InvalidArgument, "Expresión vacía o de otra calculadora");
+        for(uint32_t s: e.prog->vars)
+            if(!env.defined[s]) return fail(Status::UnknownVariable, "Variable no definida: "+env.names[s]);
+        return Status::Ok;
+    }
+    Status bindSeeds(const Variable* wrt, size_t k){
+        seeds.clear();
+        for(size_t j=0;j<k;++j){
+            if(wrt[j].owner!=this) return fail(Status::InvalidArgument, "Variable de otra calculadora");
+            seeds.push_back(wrt[j].slot);
+        }
+        return Status::Ok;
+    }
+    Status bindColumns(const Column* c, size_t n, size_t rows){
+        cols.clear();
+        for(size_t i=0;i<n;++i){
+            if(!c[i].data && rows) return fail(Status::InvalidArgument, "Columna sin datos: "+string(c[i].name));
+            cols.push_back({string(c[i].name), c[i].data});
+        }
+        return Status::Ok;
+    }
+    // Tras dar valor a pi o e, el compilador deja de plegarlas.
+    void assigned(const string& name){ if(env.consts.erase(name)) cache.clear(); }
+    // Tras una asignación: si alguna definición := falló al recalcularse (queda
+    // en NaN), devuelve el error de la primera y deja todos en lastError().
+    Status recalced(){
+        if(env.recalcErrors.empty()) return Status::Ok;
+        string msg = "Recálculo fallido: ";
+        for(size_t i=0;i<env.recalcErrors.size();++i) msg.append(i ? "; " : "").append(env.recalcErrors[i].what());
+        Status s = (Status)env.recalcErrors[0].code;
+        env.recalcErrors.clear();
+        return fail(s, move(msg));
+    }
+};
+
+static_assert((int)Status::Syntax==(int)ErrCode::Syntax && (int)Status::UnknownVariable==(int)ErrCode::UnknownVariable
+              && (int)Status::UnknownFunction==(int)ErrCode::UnknownFunction && (int)Status::Arity==(int)ErrCode::Arity
+              && (int)Status::DivisionByZero==(int)ErrCode::DivisionByZero && (int)Status::Unsupported==(int)ErrCode::Unsupported,
+              "Status y ErrCode deben coincidir");
+
+const char* statusName(Status s) noexcept {
+    switch(s){
+        case Status::Ok: return "ok";
+        case Status::Syntax: return "syntax";
+        case Status::UnknownVariable: return "unknown_variable";
+        case Status::UnknownFunction: return "unknown_function";
+        case Status::Arity: return "arity";
+        case Status::DivisionByZero: return "division_by_zero";
+        case Status::Unsupported: return "unsupported";
+        case Status::InvalidArgument: return "invalid_argument";
+        case Status::OutOfMemory: return "out_of_memory";
+    }
+    return "unknown";
+}
+
+bool Expression::isAssignment() const noexcept { return prog && !prog->prog.target.empty(); }
+
+static bool validName(string_view name){
+    if(name.empty() || !Lexer::isIdentStart(name[0])) return false;
+    for(char c: name) if(!Lexer::isIdentChar(c)) return false;
+    string n(name);
+    return !UF.count(n) && !BF.count(n);
+}
+
+Calculator::Calculator(): impl(new Impl) {}
+Calculator::~Calculator() = default;
+Calculator::Calculator(Calculator&&) noexcept = default;
+Calculator& Calculator::operator=(Calculator&&) noexcept = default;
+
+Status Calculator::compile(string_view src, Expression& out) noexcept {
+    Impl& I = *impl;
+    try{
+        auto c = make_shared<CompiledExpr>();
+        c->prog = compileRPN(toRPN(trimView(src)), I.env, true);
+        c->owner = &I;
+        c->vars = c->prog.reads;
+        out.prog = move(c);
+        return Status::Ok;
+    }catch(...){ return I.fromException(); }
+}
+
+Status Calculator::defineFunction(string_view def) noexcept {
+    Impl& I = *impl;
+    try{
+        string_view name; vector<string_view> params;
+        size_t at = parseFuncHead(def, name, params);
+        if(!at) return I.fail(Status::Syntax, "Definición inválida. Usa: f(x, y) = expresión");
+        detail::defineFunction(I.env, name, params, def.substr(at));
+        I.cache.clear();
+        return Status::Ok;
+    }catch(...){ return I.fromException(); }
+}
+
+Status Calculator::variable(string_view name, Variable& out) noexcept {
+    Impl& I = *impl;
+    if(!validName(name)) return I.fail(Status::InvalidArgument, "Nombre de variable no válido: "+string(name));
+    try{ out.owner = &I; out.slot = I.env.intern(string(name)); return Status::Ok; }
+    catch(...){ return I.fromException(); }
+}
+
+Status Calculator::set(string_view name, double value) noexcept {
+    Impl& I = *impl;
+    if(!validName(name)) return I.fail(Status::InvalidArgument, "Nombre de variable no válido: "+string(name));
+    try{
+        string n(name); I.env.set(n, value); I.assigned(n);
+        if(!I.env.formulas.empty()) onAssigned(I.env, I.env.slotOf[n]);
+        return I.recalced();
+    }catch(...){ return I.fromException(); }
+}
+
+Status Calculator::set(Variable v, double value) noexcept {
+    Impl& I = *impl;
+    if(v.owner!=&I) return I.fail(Status::InvalidArgument, "Variable de otra calculadora");
+    I.env.vals[v.slot] = value; I.env.defined[v.slot] = 1;
+    if(v.slot < 2) I.assigned(I.env.names[v.slot]); // pi y e ocupan las ranuras 0 y 1
+    if(I.env.formulas.empty()) return Status::Ok;
+    try{ onAssigned(I.env, v.slot); return I.recalced(); }
+    catch(...){ return I.fromException(); }
+}
+
+Status Calculator::define(string_view name, string_view src, double& value) noexcept {
+    Impl& I = *impl;
+    if(!validName(name)) return I.fail(Status::InvalidArgument, "Nombre de variable no válido: "+string(name));
+    try{
+        string n(name);
+        value = defineFormula(I.env, n, trimView(src));
+        I.assigned(n);
+        return I.recalced();
+    }catch(...){ return I.fromException(); }
+}
+
+Status Calculator::get(string_view name, double& out) const noexcept {
+    Impl& I = *impl;
+    try{
+        auto it = I.env.slotOf.find(string(name));
+        if(it==I.env.slotOf.end() || !I.env.defined[it->second])
+            return I.fail(Status::UnknownVariable, "Variable no definida: "+string(name));
+        out = I.env.vals[it->second];
+        return Status::Ok;
+    }catch(...){ return I.fromException(); }
+}
+
+Status Calculator::eval(const Expression& e, double& out) noexcept {
+    Impl& I = *impl;
+    Status s = I.checkExpr(e);
+    if(s!=Status::Ok) return s;
+    try{
+        out = evalProgram(e.prog->prog, I.env);
+        if(e.isAssignment() && !I.env.consts.empty()) I.assigned(e.prog->prog.target);
+        return I.recalced();
+    }catch(...){ return I.fromException(); }
+}
+
+Status Calculator::evalDiff(const Expression& e, const Variable* wrt, size_t k, double& value, double* d) noexcept {
+    Impl& I = *impl;
+    Status s = I.checkExpr(e);
+    if(s!=Status::Ok) return s;
+    if(e.isAssignment()) return I.fail(Status::Unsupported, "diff no admite asignaciones");
+    if(k && (!wrt || !d)) return I.fail(Status::InvalidArgument, "Puntero nulo");
+    try{
+        if((s = I.bindSeeds(wrt, k))!=Status::Ok) return s;
+        value = runProgramDual(e.prog->prog, I.env.vals.data(), I.seeds.data(), k, d);
+        return Status::Ok;
+    }catch(...){ return I.fromException(); }
+}
+
+Status Calculator::evalGradient(const Expression& e, const Variable* wrt, size_t k, double& value, double* d) noexcept {
+    Impl& I = *impl;
+    Status s = I.checkExpr(e);
+    if(s!=Status::Ok) return s;
+    if(e.isAssignment()) return I.fail(Status::Unsupported, "grad no admite asignaciones");
+    if(k && (!wrt || !d)) return I.fail(Status::InvalidArgument, "Puntero nulo");
+    try{
+        if((s = I.bindSeeds(wrt, k))!=Status::Ok) return s;
+        const Program& p = e.prog->prog;
+        I.tape.bind(p);
+        I.grad.assign(I.env.vals.size(), 0.0);
+        value = I.tape.forward(p, I.env.vals.data());
+        I.tape.backward(p, I.grad.data());
+        for(size_t j=0;j<k;++j) d[j] = I.grad[I.seeds[j]];
+        return Status::Ok;
+    }catch(...){ return I.fromException(); }
+}
+
+Status Calculator::evalGradientBatch(const Expression& e, const Column* cols, size_t ncols, size_t rows,
+                                     const Variable* wrt, size_t k, double* out, double* const* d) noexcept {
+    Impl& I = *impl;
+    if(!e.prog || e.prog->owner!=&I) return I.fail(Status::InvalidArgument, "Expresión vacía o de otra calculadora");
+    if((ncols && !cols) || (rows && !out) || (k && (!wrt || !d))) return I.fail(Status::InvalidArgument, "Puntero nulo");
+    try{
+        Status s = I.bindSeeds(wrt, k);
+        if(s!=Status::Ok) return s;
+        if((s = I.bindColumns(cols, ncols, rows))!=Status::Ok) return s;
+        gradColumns(e.prog->prog, I.env, I.cols, rows, I.seeds.data(), k, out, d, I.pool.get());
+        return Status::Ok;
+    }catch(...){ return I.fromException(); }
+}
+
+Status Calculator::evalBatch(const Expression& e, const Column* cols, size_t ncols, size_t rows, double* out) noexcept {
+    Impl& I = *impl;
+    if(!e.prog || e.prog->owner!=&I) return I.fail(Status::InvalidArgument, "Expresión vacía o de otra calculadora");
+    if((ncols && !cols) || (rows && !out)) return I.fail(Status::InvalidArgument, "Puntero nulo");
+    try{
+        Status s = I.bindColumns(cols, ncols, rows);
+        if(s!=Status::Ok) return s;
+        evalColumns(e.prog->prog, I.env, I.cols, rows, out, I.pool.get());
+        return Status::Ok;
+    }catch(...){ return I.fromException(); }
+}
+
+Status Calculator::evalLine(string_view line, double& out) noexcept {
+    Impl& I = *impl;
+    try{
+        line = trimView(line);
+        Program compiled;
+        const Program* prog = I.cache.find(line);
+        if(!prog){
+            string key(line);
+            compiled = compileRPN(toRPN(key), I.env);
+            prog = I.cache.put(key, compiled);
+            if(!prog) prog = &compiled;
+        }
+        out = evalProgram(*prog, I.env);
+        if(!prog->target.empty()) I.assigned(prog->target);
+        return I.recalced();
+    }catch(...){ return I.fromException(); }
+}
+
+void Calculator::setFastMath(bool on) noexcept {
+    if(impl->env.fastMath!=on){ impl->env.fastMath = on; impl->cache.clear(); }
+}
+
+void Calculator::setMemo(bool on) noexcept {
+    if(impl->env.memo!=on){ impl->env.memo = on; impl->cache.clear(); }
+}
+
+Status Calculator::setThreads(unsigned n) noexcept {
+    Impl& I = *impl;
+    if(n==0) return I.fail(Status::InvalidArgument, "Se necesita al menos un hilo");
+    try{ I.pool.reset(n>1 ? new WorkPool(n) : nullptr); I.env.recalcPool = I.pool.get(); return Status::Ok; }
+    catch(...){ return I.fromException(); }
+}
+
+void Calculator::reset() noexcept {
+    Env& env = impl->env;
+    fill(env.defined.begin(), env.defined.end(), 0);
+    fill(env.vals.begin(), env.vals.end(), NAN);
+    env.formulas.clear(); env.recalcErrors.clear(); env.funcs.clear();
+    for(auto& d: env.dependents) d.clear();
+    env.set("pi", acos(-1.0)); env.set("e", exp(1.0)); // ya internadas: no reservan
+    try{ env.consts = {"pi", "e"}; }catch(...){}
+    impl->cache.clear();
+}
+
+const string& Calculator::lastError() const noexcept { return impl->error; }
+
+} // namespace supercalc
@@ -0,0 +1,89 @@
+/* --- libsupercalc: ABI en C para llamar desde otros lenguajes (FFI) ---
+ * Misma semántica que supercalc.hpp, con punteros opacos y códigos de estado.
+ * Ninguna función deja escapar excepciones. Las cadenas son UTF-8 terminadas en
+ * '\0'; los punteros que devuelve la biblioteca son de la biblioteca (no se
+ * liberan con free). Un sc_calc no es seguro entre hilos: usa uno por hilo.
+ *
+ * La ABI solo crece: no se reordenan los valores de sc_status ni cambian las
+ * firmas existentes. sc_abi_version() permite comprobarlo en tiempo de ejecución.
+ *
+ *   sc_calc* c = sc_new();
+ *   sc_expr* f;
+ *   if (sc_compile(c, "3*x^2 + 1", &f) != SC_OK) puts(sc_last_error(c));
+ *   const char* names[] = {"x"}; const double* cols[] = {xs};
+ *   sc_eval_batch(c, f, names, cols, 1, n, out);
+ *   sc_free(f); sc_calc_free(c);
+ */
+#ifndef SUPERCALC_H
+#define SUPERCALC_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SC_ABI_VERSION 1
+
+typedef enum sc_status {
+    SC_OK = 0,
+    SC_ERR_SYNTAX = 1,
+    SC_ERR_UNKNOWN_VARIABLE = 2,
+    SC_ERR_UNKNOWN_FUNCTION = 3,
+    SC_ERR_ARITY = 4,
+    SC_ERR_DIVISION_BY_ZERO = 5,
+    SC_ERR_UNSUPPORTED = 6,
+    SC_ERR_INVALID_ARGUMENT = 7,
+    SC_ERR_OUT_OF_MEMORY = 8
+} sc_status;
+
+typedef struct sc_calc sc_calc; /* variables y opciones */
+typedef struct sc_expr sc_expr; /* expresión compilada */
+
+int sc_abi_version(void);
+const char* sc_status_name(sc_status s);
+
+/* NULL si no hay memoria. */
+sc_calc* sc_new(void);
+void sc_calc_free(sc_calc* c);
+/* Mensaje del último error de c (válido hasta la siguiente llamada con c). */
+const char* sc_last_error(const sc_calc* c);
+
+sc_status sc_set(sc_calc* c, const char* name, double value);
+sc_status sc_get(const sc_calc* c, const char* name, double* out);
+/* name := src: name se recalcula al cambiar cualquier variable de la que dependa.
+ * *value recibe el valor inicial. sc_set sobre name borra la definición.
+ * Si una asignación (sc_set, sc_eval, sc_define) hace fallar el recálculo de
+ * alguna definición, esta queda en NaN y se devuelve su error (sc_last_error
+ * las lista todas), aunque la asignación se haya hecho. */
+sc_status sc_define(sc_calc* c, const char* name, const char* src, double* value);
+/* "f(x, y) = x^2 + y": las expresiones compiladas después pueden llamar a f. */
+sc_status sc_define_function(sc_calc* c, const char* def);
+sc_status sc_set_threads(sc_calc* c, unsigned threads);
+void sc_set_fast_math(sc_calc* c, int on);
+void sc_set_memo(sc_calc* c, int on);
+
+/* Compila src; las variables sin valor quedan libres hasta evaluar. *out solo
+ * se escribe si devuelve SC_OK, y hay que liberarla con sc_free. */
+sc_status sc_compile(sc_calc* c, const char* src, sc_expr** out);
+void sc_free(sc_expr* e);
+
+/* Evalúa con los valores actuales de las variables de c. */
+sc_status sc_eval(sc_calc* c, const sc_expr* e, double* out);
+/* Valor y derivadas parciales en una pasada: d[j] = ∂e/∂names[j] (k entradas). */
+sc_status sc_eval_diff(sc_calc* c, const sc_expr* e, const char* const* names, size_t k, double* value, double* d);
+/* Igual que sc_eval_diff en modo inverso: el coste no crece con k. */
+sc_status sc_eval_grad(sc_calc* c, const sc_expr* e, const char* const* names, size_t k, double* value, double* d);
+/* rows filas en una sola llamada: la variable names[i] se lee de cols[i][0..rows)
+ * y las que no tengan columna, de su valor en c. out[r] es el resultado de la fila r. */
+sc_status sc_eval_batch(sc_calc* c, const sc_expr* e, const char* const* names, const double* const* cols,
+                        size_t ncols, size_t rows, double* out);
+/* Como sc_eval_batch y, además, el gradiente por filas: d[j][r] = ∂e/∂wrt[j] en la fila r. */
+sc_status sc_eval_grad_batch(sc_calc* c, const sc_expr* e, const char* const* names, const double* const* cols,
+                             size_t ncols, size_t rows, const char* const* wrt, size_t k, double* out, double* const* d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SUPERCALC_H */
@@ -0,0 +1,124 @@
+// --- libsupercalc: API para embeber la calculadora ---
+// Compilar una vez y evaluar muchas: compile() deja un programa reutilizable
+// (Expression) y eval() solo ejecuta su bytecode, sin analizar ni reservar
+// memoria. Las variables se enlazan por nombre o, más rápido, con un Variable
+// obtenido una vez. Ninguna función lanza excepciones: todas devuelven un
+// Status y el mensaje del último error queda en lastError().
+//
+//   supercalc::Calculator calc;
+//   supercalc::Expression f; supercalc::Variable x;
+//   calc.compile("3*x^2 + 1", f); calc.variable("x", x);
+//   double y;
+//   for(double v: datos){ calc.set(x, v); calc.eval(f, y); ... }
+//
+// Un Calculator no es seguro entre hilos; usa uno por hilo o protégelo.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace supercalc {
+
+enum class Status : int {
+    Ok = 0,
+    Syntax,          // expresión mal formada
+    UnknownVariable, // variable sin valor al evaluar
+    UnknownFunction,
+    Arity,           // número de argumentos incorrecto
+    DivisionByZero,
+    Unsupported,     // p. ej. una asignación en evalBatch
+    InvalidArgument, // Expression vacía o de otro Calculator, punteros nulos, nombre no válido
+    OutOfMemory
+};
+
+const char* statusName(Status s) noexcept; // "ok", "syntax", ...
+
+struct CompiledExpr;
+
+// Programa compilado. Copiarlo es barato (se comparte) y solo es válido con el
+// Calculator que lo compiló.
+class Expression {
+public:
+    bool valid() const noexcept { return prog != nullptr; }
+    bool isAssignment() const noexcept;  // `nombre = expr`: eval() guarda el resultado
+private:
+    friend class Calculator;
+    std::shared_ptr<const CompiledExpr> prog;
+};
+
+// Variable ya resuelta: set(Variable, v) escribe directamente en su ranura.
+class Variable {
+    friend class Calculator;
+    const void* owner = nullptr; uint32_t slot = 0;
+};
+
+// Columna de entrada para evalBatch: 'rows' valores contiguos.
+struct Column { std::string_view name; const double* data; };
+
+class Calculator {
+public:
+    Calculator();
+    ~Calculator();
+    Calculator(Calculator&&) noexcept;
+    Calculator& operator=(Calculator&&) noexcept;
+
+    // Compila 'src'. Las variables que aún no tienen valor quedan libres:
+    // basta con darles valor antes de evaluar. pi y e se pliegan mientras no se
+    // reasignen; lo compilado antes de reasignarlas conserva el valor original.
+    Status compile(std::string_view src, Expression& out) noexcept;
+
+    // "f(x, y) = x^2 + y": a partir de aquí, compile() admite llamadas a f. Los
+    // cuerpos pequeños se copian en cada llamada y se pliegan con ella; los
+    // grandes se llaman sin reservar memoria. Redefinir f no cambia las
+    // Expression ya compiladas.
+    Status defineFunction(std::string_view def) noexcept;
+
+    Status variable(std::string_view name, Variable& out) noexcept;
+    Status set(std::string_view name, double value) noexcept;
+    Status set(Variable v, double value) noexcept; // v debe ser de este Calculator
+    Status get(std::string_view name, double& out) const noexcept;
+    // `name := src`: name se recalcula sola cada vez que cambia una variable de
+    // las que lee (directa o indirectamente), también con set(). value recibe el
+    // valor inicial. Dar valor a name con set() o eval() borra la definición.
+    // Si al asignar (set, eval, evalLine o define) falla el recálculo de alguna
+    // definición, esta queda en NaN, la asignación se hace igualmente y se
+    // devuelve el error de la primera; lastError() lista todas ("y: mensaje; ...").
+    Status define(std::string_view name, std::string_view src, double& value) noexcept;
+
+    // Evalúa con los valores actuales de las variables.
+    Status eval(const Expression& e, double& out) noexcept;
+    // rows filas: cada variable se toma de la columna con su nombre o, si no hay
+    // ninguna, de su valor escalar. out[i] es el resultado de la fila i.
+    Status evalBatch(const Expression& e, const Column* cols, size_t ncols, size_t rows, double* out) noexcept;
+    // Valor y derivadas parciales en una pasada (modo directo): d[j] = ∂e/∂wrt[j].
+    // e no debe ser una asignación.
+    Status evalDiff(const Expression& e, const Variable* wrt, size_t k, double& value, double* d) noexcept;
+    // Lo mismo en modo inverso: una pasada hacia atrás da todas las parciales, así
+    // que conviene cuando k es grande.
+    Status evalGradient(const Expression& e, const Variable* wrt, size_t k, double& value, double* d) noexcept;
+    // Gradiente por filas sobre columnas (como evalBatch): d[j][r] = ∂e/∂wrt[j] en la fila r.
+    Status evalGradientBatch(const Expression& e, const Column* cols, size_t ncols, size_t rows,
+                             const Variable* wrt, size_t k, double* out, double* const* d) noexcept;
+    // compile + eval en un paso, con una caché de las líneas ya vistas (como el REPL).
+    Status evalLine(std::string_view line, double& out) noexcept;
+
+    // Reescrituras de ^ que no son exactas bit a bit; afecta a lo que se compile después.
+    void setFastMath(bool on) noexcept;
+    // Memoriza las llamadas a funciones puras (ver :memo en el README); afecta a lo que se compile después.
+    void setMemo(bool on) noexcept;
+    // Hilos para evalBatch y para recalcular definiciones (1 = secuencial, por defecto).
+    Status setThreads(unsigned n) noexcept;
+    // Borra los valores y definiciones de las variables y las funciones (quedan pi y e). Las Expression y
+    // Variable existentes siguen siendo válidas.
+    void reset() noexcept;
+
+    const std::string& lastError() const noexcept;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // namespace supercalc
@@ -0,0 +1,128 @@
+// --- libsupercalc: ABI en C (supercalc.h) sobre la API de C++ ---
+#include "supercalc.h"
+#include "supercalc.hpp"
+#include <new>
+#include <vector>
+
+using namespace supercalc;
+
+struct sc_calc {
+    Calculator calc; std::vector<Column> cols; std::vector<Variable> vars;
+    mutable const char* error = nullptr; // error propio de los envoltorios; si no, el de calc
+};
+struct sc_expr { Expression expr; };
+
+static_assert(SC_ERR_SYNTAX==(int)Status::Syntax && SC_ERR_UNKNOWN_VARIABLE==(int)Status::UnknownVariable
+              && SC_ERR_UNKNOWN_FUNCTION==(int)Status::UnknownFunction && SC_ERR_ARITY==(int)Status::Arity
+              && SC_ERR_DIVISION_BY_ZERO==(int)Status::DivisionByZero && SC_ERR_UNSUPPORTED==(int)Status::Unsupported
+              && SC_ERR_INVALID_ARGUMENT==(int)Status::InvalidArgument && SC_ERR_OUT_OF_MEMORY==(int)Status::OutOfMemory,
+              "sc_status y supercalc::Status deben coincidir");
+
+// Resultado de una llamada a calc: su mensaje, si lo hay, está en calc.lastError().
+static sc_status st(const sc_calc* c, Status s){ c->error = nullptr; return (sc_status)s; }
+// Fallos de los propios envoltorios, con su mensaje para sc_last_error.
+static sc_status fail(const sc_calc* c, sc_status s){
+    if(c) c->error = s==SC_ERR_OUT_OF_MEMORY ? "Memoria insuficiente" : "Puntero nulo";
+    return s;
+}
+
+extern "C" {
+
+int sc_abi_version(void){ return SC_ABI_VERSION; }
+const char* sc_status_name(sc_status s){ return statusName((Status)s); }
+
+sc_calc* sc_new(void){
+    try{ return new sc_calc; }catch(...){ return nullptr; }
+}
+void sc_calc_free(sc_calc* c){ delete c; }
+const char* sc_last_error(const sc_calc* c){ return !c ? "" : c->error ? c->error : c->calc.lastError().c_str(); }
+
+sc_status sc_set(sc_calc* c, const char* name, double value){
+    if(!c || !name) return fail(c, SC_ERR_INVALID_ARGUMENT);
+    return st(c, c->calc.set(name, value));
+}
+sc_status sc_get(const sc_calc* c, const char* name, double* out){
+    if(!c || !name || !out) return fail(c, SC_ERR_INVALID_ARGUMENT);
+    return st(c, c->calc.get(name, *out));
+}
+sc_status sc_define(sc_calc* c, const char* name, const char* src, double* value){
+    if(!c || !name || !src || !value) return fail(c, SC_ERR_INVALID_ARGUMENT);
+    return st(c, c->calc.define(name, src, *value));
+}
+sc_status sc_define_function(sc_calc* c, const char* def){
+    if(!c || !def) return fail(c, SC_ERR_INVALID_ARGUMENT);
+    return st(c, c->calc.defineFunction(def));
+}
+sc_status sc_set_threads(sc_calc* c, unsigned threads){
+    if(!c) return fail(c, SC_ERR_INVALID_ARGUMENT);
+    return st(c, c->calc.setThreads(threads));
+}
+void sc_set_fast_math(sc_calc* c, int on){ if(c) c->calc.setFastMath(on!=0); }
+void sc_set_memo(sc_calc* c, int on){ if(c) c->calc.setMemo(on!=0); }
+
+sc_status sc_compile(sc_calc* c, const char* src, sc_expr** out){
+    if(!c || !src || !out) return fail(c, SC_ERR_INVALID_ARGUMENT);
+    sc_expr* e = new(std::nothrow) sc_expr;
+    if(!e) return fail(c, SC_ERR_OUT_OF_MEMORY);
+    Status s = c->calc.compile(src, e->expr);
+    if(s!=Status::Ok){ delete e; return st(c, s); }
+    *out = e;
+    return SC_OK;
+}
+void sc_free(sc_expr* e){ delete e; }
+
+sc_status sc_eval(sc_calc* c, const sc_expr* e, double* out){
+    if(!c || !e || !out) return fail(c, SC_ERR_INVALID_ARGUMENT);
+    return st(c, c->calc.eval(e->expr, *out));
+}
+
+// Resuelve los nombres de las variables de derivación en c->vars.
+static sc_status bindVars(sc_calc* c, const char* const* names, size_t k){
+    try{ c->vars.resize(k); }catch(...){ return fail(c, SC_ERR_OUT_OF_MEMORY); }
+    for(size_t j=0;j<k;++j){
+        if(!names[j]) return fail(c, SC_ERR_INVALID_ARGUMENT);
+        Status s = c->calc.variable(names[j], c->vars[j]);
+        if(s!=Status::Ok) return st(c, s);
+    }
+    return SC_OK;
+}
+
+static sc_status bindCols(sc_calc* c, const char* const* names, const double* const* cols, size_t ncols){
+    try{
+        c->cols.clear();
+        for(size_t i=0;i<ncols;++i){
+            if(!names[i]) return fail(c, SC_ERR_INVALID_ARGUMENT);
+            c->cols.push_back({names[i], cols[i]});
+        }
+    }catch(...){ return fail(c, SC_ERR_OUT_OF_MEMORY); }
+    return SC_OK;
+}
+
+sc_status sc_eval_diff(sc_calc* c, const sc_expr* e, const char* const* names, size_t k, double* value, double* d){
+    if(!c || !e || !value || (k && (!names || !d))) return fail(c, SC_ERR_INVALID_ARGUMENT);
+    sc_status s = bindVars(c, names, k);
+    return s!=SC_OK ? s : st(c, c->calc.evalDiff(e->expr, c->vars.data(), k, *value, d));
+}
+
+sc_status sc_eval_grad(sc_calc* c, const sc_expr* e, const char* const* names, size_t k, double* value, double* d){
+    if(!c || !e || !value || (k && (!names || !d))) return fail(c, SC_ERR_INVALID_ARGUMENT);
+    sc_status s = bindVars(c, names, k);
+    return s!=SC_OK ? s : st(c, c->calc.evalGradient(e->expr, c->vars.data(), k, *value, d));
+}
+
+sc_status sc_eval_batch(sc_calc* c, const sc_expr* e, const char* const* names, const double* const* cols,
+                        size_t ncols, size_t rows, double* out){
+    if(!c || !e || (ncols && (!names || !cols))) return fail(c, SC_ERR_INVALID_ARGUMENT);
+    sc_status s = bindCols(c, names, cols, ncols);
+    return s!=SC_OK ? s : st(c, c->calc.evalBatch(e->expr, c->cols.data(), ncols, rows, out));
+}
+
+sc_status sc_eval_grad_batch(sc_calc* c, const sc_expr* e, const char* const* names, const double* const* cols,
+                             size_t ncols, size_t rows, const char* const* wrt, size_t k, double* out, double* const* d){
+    if(!c || !e || (ncols && (!names || !cols)) || (k && (!wrt || !d))) return fail(c, SC_ERR_INVALID_ARGUMENT);
+    sc_status s = bindCols(c, names, cols, ncols);
+    if(s==SC_OK) s = bindVars(c, wrt, k);
+    return s!=SC_OK ? s : st(c, c->calc.evalGradientBatch(e->expr, c->cols.data(), ncols, rows, c->vars.data(), k, out, d));
+}
+
+} // extern "C"